@@ -0,0 +1,84 @@
+#include "allocation_counter.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+using namespace std;
+
+#if defined(TUNER_ALLOCATION_STATS)
+
+// Replaces the global allocation functions to count every heap allocation per thread.
+// The array and nothrow forms forward to these, so they are counted as well.
+
+// Constant initialized, so counting works before any other static or thread local is set up
+static thread_local uint64_t thread_allocation_count = 0;
+
+uint64_t get_thread_allocation_count()
+{
+    return thread_allocation_count;
+}
+
+void* operator new(size_t size)
+{
+    thread_allocation_count++;
+    if (const auto pointer = malloc(size > 0 ? size : 1))
+    {
+        return pointer;
+    }
+    throw bad_alloc();
+}
+
+void* operator new(size_t size, const align_val_t alignment)
+{
+    thread_allocation_count++;
+    const auto alignment_size = static_cast<size_t>(alignment);
+    size = (max<size_t>(size, 1) + alignment_size - 1) / alignment_size * alignment_size;
+#if defined(_WIN32)
+    const auto pointer = _aligned_malloc(size, alignment_size);
+#else
+    const auto pointer = aligned_alloc(alignment_size, size);
+#endif
+    if (pointer)
+    {
+        return pointer;
+    }
+    throw bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept
+{
+    free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+    free(pointer);
+}
+
+void operator delete(void* pointer, align_val_t) noexcept
+{
+#if defined(_WIN32)
+    _aligned_free(pointer);
+#else
+    free(pointer);
+#endif
+}
+
+void operator delete(void* pointer, size_t, const align_val_t alignment) noexcept
+{
+    operator delete(pointer, alignment);
+}
+
+#else
+
+uint64_t get_thread_allocation_count()
+{
+    return 0;
+}
+
+#endif
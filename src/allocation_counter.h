@@ -0,0 +1,17 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H 1
+
+#include <cstdint>
+
+// Heap allocations are only counted in builds configured with TUNER_ALLOCATION_STATS, which replaces the global
+// operator new and delete of the whole program to do so
+#if defined(TUNER_ALLOCATION_STATS)
+constexpr bool allocation_stats = true;
+#else
+constexpr bool allocation_stats = false;
+#endif
+
+// Number of heap allocations the calling thread made through the global operator new since it started, 0 without allocation_stats
+uint64_t get_thread_allocation_count();
+
+#endif // !ALLOCATION_COUNTER_H
@@ -0,0 +1,88 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+using namespace std;
+
+// Large enough that loading a position never needs more than the first block
+constexpr size_t arena_block_size = 1 << 20;
+
+static thread_local Arena* thread_arena = nullptr;
+
+void* Arena::allocate(const size_t size, const size_t alignment)
+{
+    while (true)
+    {
+        if (block_index < blocks.size())
+        {
+            auto& block = blocks[block_index];
+            const auto address = reinterpret_cast<uintptr_t>(block.data.get());
+            const auto aligned_offset = (address + block_offset + alignment - 1) / alignment * alignment - address;
+            if (aligned_offset + size <= block.size)
+            {
+                block_offset = aligned_offset + size;
+                return block.data.get() + aligned_offset;
+            }
+
+            // Blocks later in the list may still be too small for this allocation, they are skipped over until one fits
+            if (block_index + 1 < blocks.size())
+            {
+                block_index++;
+                block_offset = 0;
+                continue;
+            }
+        }
+
+        const auto block_size = max(arena_block_size, size + alignment);
+        blocks.push_back(Block{make_unique<byte[]>(block_size), block_size});
+        block_index = blocks.size() - 1;
+        block_offset = 0;
+    }
+}
+
+bool Arena::owns(const void* pointer) const
+{
+    const auto address = static_cast<const byte*>(pointer);
+    return any_of(blocks.begin(), blocks.end(), [address](const Block& block)
+    {
+        return address >= block.data.get() && address < block.data.get() + block.size;
+    });
+}
+
+void Arena::rewind(const Position position)
+{
+    block_index = position.block_index;
+    block_offset = position.block_offset;
+}
+
+Arena* get_thread_arena()
+{
+    return thread_arena;
+}
+
+ThreadArenaScope::ThreadArenaScope(Arena& arena) : previous(thread_arena)
+{
+    thread_arena = &arena;
+}
+
+ThreadArenaScope::~ThreadArenaScope()
+{
+    thread_arena = previous;
+}
+
+ArenaMark::ArenaMark() : arena(thread_arena)
+{
+    if (arena)
+    {
+        position = arena->position();
+    }
+}
+
+ArenaMark::~ArenaMark()
+{
+    if (arena)
+    {
+        arena->rewind(position);
+    }
+}
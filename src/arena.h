@@ -0,0 +1,101 @@
+#ifndef ARENA_H
+#define ARENA_H 1
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Bump allocator for short lived temporaries. Memory is handed out from large blocks and only given back
+// all at once by rewinding, the blocks themselves are kept, so a warmed up arena does not touch the heap again.
+class Arena {
+public:
+    struct Position
+    {
+        size_t block_index = 0;
+        size_t block_offset = 0;
+    };
+
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t alignment);
+    bool owns(const void* pointer) const;
+    Position position() const { return {block_index, block_offset}; }
+    // Frees everything allocated after position was taken
+    void rewind(Position position);
+
+private:
+    struct Block
+    {
+        std::unique_ptr<std::byte[]> data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks;
+    size_t block_index = 0;
+    size_t block_offset = 0;
+};
+
+// Arena of the calling thread, nullptr when it has none
+Arena* get_thread_arena();
+
+// Makes arena the arena of the calling thread while it is in scope
+class ThreadArenaScope {
+public:
+    explicit ThreadArenaScope(Arena& arena);
+    ~ThreadArenaScope();
+    ThreadArenaScope(const ThreadArenaScope&) = delete;
+    ThreadArenaScope& operator=(const ThreadArenaScope&) = delete;
+
+private:
+    Arena* previous;
+};
+
+// Frees what the thread's arena handed out while it is in scope, declared before the temporaries it covers
+class ArenaMark {
+public:
+    ArenaMark();
+    ~ArenaMark();
+    ArenaMark(const ArenaMark&) = delete;
+    ArenaMark& operator=(const ArenaMark&) = delete;
+
+private:
+    Arena* arena;
+    Arena::Position position;
+};
+
+// Allocates from the calling thread's arena if it has one and from the heap otherwise.
+// Freeing arena memory does nothing, it is reclaimed once the enclosing ArenaMark ends.
+template<typename T>
+struct ArenaAllocator
+{
+    using value_type = T;
+
+    ArenaAllocator() = default;
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>&) {}
+
+    T* allocate(const size_t count)
+    {
+        if (const auto arena = get_thread_arena())
+        {
+            return static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T)));
+        }
+        return std::allocator<T>().allocate(count);
+    }
+
+    void deallocate(T* pointer, const size_t count)
+    {
+        if (const auto arena = get_thread_arena(); arena && arena->owns(pointer))
+        {
+            return;
+        }
+        std::allocator<T>().deallocate(pointer, count);
+    }
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U>&) const { return true; }
+};
+
+#endif // !ARENA_H
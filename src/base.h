@@ -1,6 +1,8 @@
 #ifndef BASE_H
 #define BASE_H
 
+#include "arena.h"
+
 #include <array>
 #include <cstdint>
 #include <vector>
@@ -10,13 +12,17 @@
 using tune_t = double;
 
 #if TAPERED
+template<typename T>
+using basic_parameters_t = std::vector<std::array<T, 2>>;
 using pair_t       = std::array<tune_t, 2>;
-using parameters_t = std::vector<pair_t>;
 #else
-using parameters_t = std::vector<tune_t>;
+template<typename T>
+using basic_parameters_t = std::vector<T>;
 #endif
+using parameters_t = basic_parameters_t<tune_t>;
 
-using coefficients_t = std::vector<int16_t>;
+// Built for every loaded position, so the loader hands them out from the load thread's arena
+using coefficients_t = std::vector<int16_t, ArenaAllocator<int16_t>>;
 
 struct EvalResult
 {
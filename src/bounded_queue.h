@@ -0,0 +1,169 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H 1
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+// Lock-free multi-producer multi-consumer queue with a fixed power of two capacity.
+// Each cell carries a sequence number telling producers and consumers whose turn it is, so neither side ever locks.
+// push and pop block on a full or empty queue, they spin briefly and then sleep until the other side makes progress.
+template<typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity)
+        : cells(new Cell[capacity]), mask(capacity - 1)
+    {
+        if (capacity < 2 || (capacity & (capacity - 1)) != 0)
+        {
+            throw std::invalid_argument("BoundedQueue capacity must be a power of two");
+        }
+
+        for (size_t index = 0; index < capacity; index++)
+        {
+            cells[index].sequence.store(index, std::memory_order_relaxed);
+        }
+    }
+
+    bool try_push(T value)
+    {
+        size_t position = enqueue_position.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell& cell = cells[position & mask];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+            if (difference == 0)
+            {
+                if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    cell.value = std::move(value);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    push_count.fetch_add(1, std::memory_order_release);
+                    push_count.notify_one();
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = enqueue_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop(T& value)
+    {
+        size_t position = dequeue_position.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell& cell = cells[position & mask];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+            if (difference == 0)
+            {
+                if (dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    value = std::move(cell.value);
+                    cell.sequence.store(position + mask + 1, std::memory_order_release);
+                    pop_count.fetch_add(1, std::memory_order_release);
+                    pop_count.notify_one();
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = dequeue_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void push(const T& value)
+    {
+        for (int32_t attempt = 0;; attempt++)
+        {
+            // Read before the attempt, so a pop completing after a failed attempt changes it and the wait returns
+            const auto popped = pop_count.load(std::memory_order_acquire);
+            if (try_push(value))
+            {
+                return;
+            }
+            wait_after(attempt, pop_count, popped);
+        }
+    }
+
+    T pop()
+    {
+        T value;
+        for (int32_t attempt = 0;; attempt++)
+        {
+            const auto pushed = get_push_count();
+            if (try_pop(value))
+            {
+                return value;
+            }
+            wait_after(attempt, push_count, pushed);
+        }
+    }
+
+    // For consumers that also wait on something besides the queue: read the push count, check everything, then wait_for_push
+    // with it and the number of consecutive failed attempts. The wait returns once anything is pushed after the count was read,
+    // or wake_consumers is called.
+    uint32_t get_push_count() const
+    {
+        return push_count.load(std::memory_order_acquire);
+    }
+
+    void wait_for_push(const uint32_t seen_push_count, const int32_t attempt) const
+    {
+        wait_after(attempt, push_count, seen_push_count);
+    }
+
+    void wake_consumers()
+    {
+        push_count.fetch_add(1, std::memory_order_release);
+        push_count.notify_all();
+    }
+
+private:
+    // Full or empty queues are usually refilled within microseconds, so the first attempts only yield
+    static constexpr int32_t spin_attempts = 64;
+
+    static void wait_after(const int32_t attempt, const std::atomic<uint32_t>& count, const uint32_t seen_count)
+    {
+        if (attempt < spin_attempts)
+        {
+            std::this_thread::yield();
+        }
+        else
+        {
+            count.wait(seen_count, std::memory_order_acquire);
+        }
+    }
+
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    const size_t mask;
+    alignas(64) std::atomic<size_t> enqueue_position = 0;
+    alignas(64) std::atomic<size_t> dequeue_position = 0;
+    // Completed pushes and pops, only compared for changes so they may wrap around. 32 bits wide to wait on them with a futex.
+    alignas(64) std::atomic<uint32_t> push_count = 0;
+    alignas(64) std::atomic<uint32_t> pop_count = 0;
+};
+
+#endif // !BOUNDED_QUEUE_H
@@ -1,6 +1,7 @@
 #ifndef CONFIG_H
 #define CONFIG_H 1
 
+#include <cstddef>
 #include <cstdint>
 
 #include "engines/baryonyx.hpp"
@@ -10,4 +11,59 @@ using TuneEval = baryonyx::eval;
 constexpr int32_t data_load_thread_count = 6;
 constexpr int32_t thread_count = 12;
 
+// Binds each tuning thread to one processor, spread evenly over the NUMA nodes. Each thread's share of the entries
+// is then placed on its own node and the per-thread gradients are summed within each node first.
+// Always the first processors of each node, so only worth it when the tuner has the machine to itself.
+constexpr bool pin_threads = false;
+// Advises the kernel to back large entry columns with transparent huge pages (Linux only)
+constexpr bool use_huge_pages = true;
+
+// Stores parsed entries of each data source next to it as <path>.cache and reuses them on later runs
+constexpr bool enable_entry_cache = true;
+
+// Merges entries of identical positions across all data sources into one weighted entry with the averaged WDL
+constexpr bool enable_deduplication = false;
+
+// Out-of-core tuning for training sets larger than memory. With a limit above 0 the entries are written to shard files in
+// entry_shard_directory as the data sources are parsed, and every pass streams them back with at most this many bytes
+// of entries in memory. The entry cache is not used then.
+constexpr size_t out_of_core_memory_limit = 0;
+constexpr const char* entry_shard_directory = "entry_shards";
+
+// Coefficients non-zero in at least this fraction of the entries are stored as a dense block per entry
+// instead of in the sparse encoding. The block has a fixed cost per entry of a few sparse coefficients,
+// so it is only used once at least dense_coefficient_min_count coefficients qualify.
+constexpr double dense_coefficient_min_frequency = 0.9;
+constexpr size_t dense_coefficient_min_count = 8;
+
+// Renumbers the parameters internally so frequently used parameters, and parameters used by the same positions,
+// are next to each other in memory. The parameters are still printed in the order of the evaluation.
+constexpr bool enable_parameter_reordering = false;
+
+// Evaluations with more parameters than gradient_tile_parameter_count compute the gradient in tiles of that many
+// parameters, so the part of each thread's gradient being accumulated into stays in the L2 cache. Past
+// gradient_max_tile_count tiles each entry has too few coefficients per tile and the plain kernel is used again.
+constexpr size_t gradient_tile_parameter_count = 65536;
+constexpr size_t gradient_max_tile_count = 6;
+
+// With --float-kernels the epochs store and evaluate the entries in float, accumulating the error and the gradient
+// in float with Kahan summation instead of in tune_t
+constexpr bool compensated_kernel_sums = false;
+
+// Epochs between the error lines printed in between the full reports every 100 epochs. The error is a by-product
+// of the gradient pass and is that of the parameters each epoch starts from.
+constexpr int32_t error_print_interval = 1;
+
+// Highest instruction set the hand-vectorized kernels of tapered double precision tuning may use. The best one the
+// processor supports up to this is picked at startup, so a single binary runs on all machines. The AVX-512 kernels
+// rely on gathers and scatters and are only faster where those are, so they have to be allowed explicitly.
+enum class KernelIsa { Scalar, Avx2, Avx512 };
+constexpr KernelIsa max_kernel_isa = KernelIsa::Avx2;
+
+// Position sampling for PGN data sources: plies skipped at the start of each game, then every n-th position is taken
+constexpr int32_t pgn_skip_plies = 8;
+constexpr int32_t pgn_sample_interval = 1;
+// Drops sampled positions where the side to move is in check or the move played from them is a capture
+constexpr bool pgn_filter_noisy = true;
+
 #endif // CONFIG_H
\ No newline at end of file
@@ -0,0 +1,119 @@
+#include "deduplication.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <memory>
+
+using namespace std;
+using namespace Tuner;
+
+// Open addressing table mapping a position key to the index of its first entry. Slots are claimed with a CAS on the key,
+// the first index is lowered with a CAS loop, so once loading is done the pool threads insert slices of the entries concurrently without locks.
+class PositionTable {
+public:
+    explicit PositionTable(const size_t entry_count)
+        : mask(bit_ceil(max<size_t>(entry_count * 2, 2)) - 1),
+          keys(make_unique<atomic<uint64_t>[]>(mask + 1)),
+          first_entries(make_unique<atomic<uint64_t>[]>(mask + 1))
+    {
+        for (size_t slot = 0; slot <= mask; slot++)
+        {
+            keys[slot].store(empty_key, memory_order_relaxed);
+            first_entries[slot].store(UINT64_MAX, memory_order_relaxed);
+        }
+    }
+
+    size_t insert(uint64_t key, const uint64_t entry_index)
+    {
+        // 0 marks an empty slot, the odd position hashing to it shares a slot with key 1
+        key = key == empty_key ? 1 : key;
+        for (size_t slot = key & mask;; slot = (slot + 1) & mask)
+        {
+            auto slot_key = keys[slot].load(memory_order_acquire);
+            if (slot_key == empty_key && keys[slot].compare_exchange_strong(slot_key, key, memory_order_acq_rel))
+            {
+                slot_key = key;
+            }
+
+            if (slot_key == key)
+            {
+                auto first_entry = first_entries[slot].load(memory_order_relaxed);
+                while (entry_index < first_entry && !first_entries[slot].compare_exchange_weak(first_entry, entry_index, memory_order_relaxed))
+                {
+                }
+                return slot;
+            }
+        }
+    }
+
+    uint64_t get_first_entry(const size_t slot) const
+    {
+        return first_entries[slot].load(memory_order_relaxed);
+    }
+
+private:
+    static constexpr uint64_t empty_key = 0;
+
+    const size_t mask;
+    unique_ptr<atomic<uint64_t>[]> keys;
+    unique_ptr<atomic<uint64_t>[]> first_entries;
+};
+
+size_t Tuner::deduplicate_entries(ThreadPool& thread_pool, EntryList& entries)
+{
+    PositionTable table(entries.size());
+    vector<size_t> entry_slots(entries.size());
+    const auto keys = entries.get_keys();
+
+    const auto task_count = static_cast<size_t>(thread_pool.thread_count());
+    const auto entries_per_task = (entries.size() + task_count - 1) / task_count;
+    for (size_t task_index = 0; task_index < task_count; task_index++)
+    {
+        thread_pool.enqueue([&, task_index]()
+        {
+            const auto start = min(task_index * entries_per_task, entries.size());
+            const auto end = min(start + entries_per_task, entries.size());
+            for (auto entry_index = start; entry_index < end; entry_index++)
+            {
+                entry_slots[entry_index] = table.insert(keys[entry_index], entry_index);
+            }
+        });
+    }
+    thread_pool.wait_for_completion();
+
+    // Merged in entry order, the first occurrence accumulates the weighted WDL sum of all its duplicates
+    const auto wdls = entries.get_wdls();
+    const auto weights = entries.get_weights();
+    for (size_t entry_index = 0; entry_index < entries.size(); entry_index++)
+    {
+        wdls[entry_index] *= weights[entry_index];
+    }
+
+    vector<bool> duplicates(entries.size());
+    for (size_t entry_index = 0; entry_index < entries.size(); entry_index++)
+    {
+        const auto first_entry = table.get_first_entry(entry_slots[entry_index]);
+        if (first_entry != entry_index)
+        {
+            wdls[first_entry] += wdls[entry_index];
+            weights[first_entry] += weights[entry_index];
+            duplicates[entry_index] = true;
+        }
+    }
+
+    size_t collapsed_count = 0;
+    for (size_t entry_index = 0; entry_index < entries.size(); entry_index++)
+    {
+        if (duplicates[entry_index])
+        {
+            collapsed_count++;
+            continue;
+        }
+        wdls[entry_index] /= weights[entry_index];
+    }
+
+    entries.erase(duplicates);
+    return collapsed_count;
+}
@@ -0,0 +1,19 @@
+#ifndef DEDUPLICATION_H
+#define DEDUPLICATION_H 1
+
+#include "config.h"
+#include "entry.h"
+#include "threadpool.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace Tuner
+{
+    // Collapses entries with the same position key into one entry with the averaged WDL and the summed weight.
+    // The first occurrence of each position is kept in place, so the result does not depend on thread timing.
+    // Returns the number of entries that were collapsed.
+    size_t deduplicate_entries(ThreadPool& thread_pool, EntryList& entries);
+}
+
+#endif // !DEDUPLICATION_H
@@ -1,5 +1,6 @@
 #include "baryonyx.hpp"
 
+#include <bit>
 #include <cmath>
 #include <format>
 #include <iostream>
@@ -334,4 +335,46 @@ namespace baryonyx
 
         return result;
     }
+
+    EvalResult eval::get_external_eval_result(const chess::Board& board)
+    {
+        // Both libraries number pieces and squares the same way, so the board converts without going through a FEN
+        position pos;
+        u64      occupied = board.occ().getBits();
+        while (occupied)
+        {
+            const auto sq = std::countr_zero(occupied);
+            occupied &= occupied - 1;
+
+            const auto p = board.at(chess::Square(sq));
+            pos.set_piece(static_cast<piece>(static_cast<u8>(p.internal())), static_cast<square>(sq));
+        }
+        pos.set_side_to_move(board.sideToMove() == chess::Color::WHITE ? color::white : color::black);
+
+        // Everything else a FEN of the board carries, so the result matches get_fen_eval_result(board.getFen())
+        using side = chess::Board::CastlingRights::Side;
+        using flag = castling_rights::castling_flag;
+        const auto      rights = board.castlingRights();
+        castling_rights castling;
+        if (rights.has(chess::Color::WHITE, side::KING_SIDE))
+            castling |= castling_rights(flag::wk);
+        if (rights.has(chess::Color::WHITE, side::QUEEN_SIDE))
+            castling |= castling_rights(flag::wq);
+        if (rights.has(chess::Color::BLACK, side::KING_SIDE))
+            castling |= castling_rights(flag::bk);
+        if (rights.has(chess::Color::BLACK, side::QUEEN_SIDE))
+            castling |= castling_rights(flag::bq);
+        pos.set_castling(castling);
+
+        const auto ep_sq = board.enpassantSq();
+        pos.set_ep_square(ep_sq == chess::Square::underlying::NO_SQ ? square::none : static_cast<square>(ep_sq.index()));
+        pos.set_move_counters(static_cast<u8>(board.halfMoveClock()), static_cast<u16>(board.fullMoveNumber()));
+
+        EvalResult result;
+        const auto trace    = evaluate(pos);
+        result.score        = trace.score;
+        result.coefficients = get_coefficients(trace);
+
+        return result;
+    }
 }
@@ -14,7 +14,7 @@ namespace baryonyx
     {
     public:
         static constexpr bool   includes_additional_score    = true;
-        static constexpr bool   supports_external_chess_eval = false;
+        static constexpr bool   supports_external_chess_eval = true;
         static constexpr bool   retune_from_zero             = true;
         static constexpr tune_t preferred_k                  = 2.8;
         static constexpr i32    max_epoch                    = 5000;
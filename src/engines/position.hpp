@@ -2,7 +2,9 @@
 
 #include <array>
 #include <cctype>
+#include <charconv>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "bitboard.hpp"
@@ -11,22 +13,24 @@ namespace baryonyx
 {
     namespace utils
     {
-        inline std::vector<std::string> split_string(const std::string& str, const char delim)
+        // Splits without allocating, fields past the end of str are left empty
+        template<usize N>
+        constexpr std::array<std::string_view, N> split_fields(const std::string_view str, const char delim)
         {
-            std::vector<std::string> tokens;
-            usize                    start = 0;
-            usize                    end   = str.find(delim);
+            std::array<std::string_view, N> fields{};
+            usize                           start = 0;
 
-            while (end != std::string::npos)
+            for (usize i = 0; i < N && start <= str.size(); ++i)
             {
-                tokens.emplace_back(str.substr(start, end - start));
-                start = end + 1;
-                end   = str.find(delim, start);
-            }
+                auto end = str.find(delim, start);
+                if (end == std::string_view::npos)
+                    end = str.size();
 
-            tokens.emplace_back(str.substr(start));
+                fields[i] = str.substr(start, end - start);
+                start     = end + 1;
+            }
 
-            return tokens;
+            return fields;
         }
 
         constexpr piece char_to_piece(const char c)
@@ -130,7 +134,7 @@ namespace baryonyx
 
         constexpr explicit castling_rights(const castling_flag flag) : m_flags(flag) {}
 
-        constexpr explicit castling_rights(const std::string& flags) : m_flags(castling_flag::none)
+        constexpr explicit castling_rights(const std::string_view flags) : m_flags(castling_flag::none)
         {
             for (const char c: flags)
             {
@@ -240,43 +244,45 @@ namespace baryonyx
             m_pieces.fill(piece::none);
         }
 
-        explicit position(const std::string& fen): m_pieces()
+        explicit position(const std::string_view fen): m_pieces()
         {
             m_pieces.fill(piece::none);
 
-            const auto tokens = utils::split_string(fen, ' ');
-            const auto ranks  = utils::split_string(tokens[0], '/');
+            const auto tokens = utils::split_fields<6>(fen, ' ');
 
             int rank_index = constants::num_ranks - 1;
+            u8  file_index = 0;
 
-            for (const auto& rank: ranks)
+            for (const auto c: tokens[0])
             {
-                u8 file_index = 0;
-
-                for (const auto c: rank)
+                if (c == '/')
+                {
+                    --rank_index;
+                    file_index = 0;
+                }
+                else if (std::isdigit(c))
+                    file_index += c - '0';
+                else
                 {
-                    if (std::isdigit(c))
-                        file_index += c - '0';
-                    else
-                    {
-                        const square sq    = square_of(file_index, rank_index);
-                        const piece  piece = utils::char_to_piece(c);
-
-                        set_piece(piece, sq);
-                        ++file_index;
-                    }
+                    const square sq    = square_of(file_index, rank_index);
+                    const piece  piece = utils::char_to_piece(c);
+
+                    set_piece(piece, sq);
+                    ++file_index;
                 }
-                --rank_index;
             }
 
             m_stm      = tokens[1] == "w" ? color::white : color::black;
             m_castling = castling_rights(tokens[2]);
 
             const auto& en_passant = tokens[3];
-            m_ep_sq = en_passant == "-" ? square::none : square_of(en_passant[0] - 'a', en_passant[1] - 1 - '0');
+            m_ep_sq = en_passant.size() < 2 ? square::none : square_of(en_passant[0] - 'a', en_passant[1] - 1 - '0');
 
-            m_half_move_clock  = std::stoi(tokens[4]);
-            m_full_move_number = std::stoi(tokens[5]);
+            // Move counters are optional, the tuner passes only the first four fields
+            m_half_move_clock  = 0;
+            m_full_move_number = 1;
+            std::from_chars(tokens[4].data(), tokens[4].data() + tokens[4].size(), m_half_move_clock);
+            std::from_chars(tokens[5].data(), tokens[5].data() + tokens[5].size(), m_full_move_number);
         }
 
         [[nodiscard]] color           side_to_move() const { return m_stm; }
@@ -317,6 +323,16 @@ namespace baryonyx
             bitboard::set_bit(m_occupied_bb[static_cast<u8>(utils::piece_color(p))], sq);
         }
 
+        void set_side_to_move(const color c) { m_stm = c; }
+        void set_castling(const castling_rights castling) { m_castling = castling; }
+        void set_ep_square(const square sq) { m_ep_sq = sq; }
+
+        void set_move_counters(const u8 half_move_clock, const u16 full_move_number)
+        {
+            m_half_move_clock  = half_move_clock;
+            m_full_move_number = full_move_number;
+        }
+
     private:
         std::array<piece, constants::num_squares>        m_pieces;
         std::array<bitboard, constants::num_piece_types> m_piece_bb;
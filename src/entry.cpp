@@ -0,0 +1,453 @@
+#include "entry.h"
+
+#include <algorithm>
+#include <istream>
+#include <iostream>
+#include <ostream>
+#include <stdexcept>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+// Appends the encoding of the coefficients of one entry, which have to be sorted by index
+static void encode_coefficients(const span<const CoefficientEntry> coefficients, column_t<CoefficientWord>& encoded)
+{
+    int64_t previous_index = 0;
+    for (size_t coefficient_index = 0; coefficient_index < coefficients.size(); coefficient_index++)
+    {
+        const auto& coefficient = coefficients[coefficient_index];
+        if ((coefficient_index > 0 && coefficient.index <= previous_index) || coefficient.index < 0 || coefficient.value == 0)
+        {
+            cout << "Coefficient " << coefficient.index << " with value " << coefficient.value << " is zero or out of order" << endl;
+            throw runtime_error("Invalid coefficients");
+        }
+
+        const auto distance = static_cast<uint32_t>(coefficient.index - previous_index);
+        const bool compact_value = coefficient.value >= coefficient_min_value && coefficient.value <= coefficient_max_value;
+        const auto value_code = compact_value ? static_cast<uint32_t>(coefficient.value < 0 ? coefficient.value + 9 : coefficient.value + 8) : coefficient_escape_code;
+        previous_index = coefficient.index;
+        if (compact_value && distance <= coefficient_max_distance)
+        {
+            encoded.push_back(static_cast<CoefficientWord>((distance << 4) | value_code));
+            continue;
+        }
+
+        encoded.push_back(static_cast<CoefficientWord>((value_code << 4) | coefficient_escape_code));
+        encoded.push_back(static_cast<CoefficientWord>(distance >> 16));
+        encoded.push_back(static_cast<CoefficientWord>(distance));
+        if (!compact_value)
+        {
+            encoded.push_back(static_cast<CoefficientWord>(coefficient.value));
+        }
+    }
+}
+
+constexpr size_t huge_page_size = 2 << 20;
+
+void* allocate_column(const size_t size)
+{
+    if (size < huge_page_size)
+    {
+        return ::operator new(size, align_val_t(entry_column_alignment));
+    }
+
+    // Whole huge pages, so the advice never covers memory of another allocation
+    const auto rounded_size = (size + huge_page_size - 1) / huge_page_size * huge_page_size;
+    const auto pointer = ::operator new(rounded_size, align_val_t(huge_page_size));
+#if defined(__linux__)
+    if constexpr (use_huge_pages)
+    {
+        madvise(pointer, rounded_size, MADV_HUGEPAGE);
+    }
+#endif
+    return pointer;
+}
+
+void free_column(void* pointer, const size_t size)
+{
+    if (size < huge_page_size)
+    {
+        ::operator delete(pointer, align_val_t(entry_column_alignment));
+        return;
+    }
+
+    ::operator delete(pointer, align_val_t(huge_page_size));
+}
+
+template<typename Scalar>
+void BasicEntryList<Scalar>::reserve(const size_t entry_count, const size_t encoded_coefficient_size)
+{
+    for_each_column([entry_count](auto& column) { column.reserve(entry_count); });
+    offsets.reserve(entry_count + 1);
+    coefficients.reserve(encoded_coefficient_size);
+}
+
+template<typename Scalar>
+template<typename OtherScalar>
+void BasicEntryList<Scalar>::allocate_like(const BasicEntryList<OtherScalar>& other)
+{
+    wdls.resize(other.size());
+    weights.resize(other.size());
+    additional_scores.resize(other.size());
+#if TAPERED
+    midgame_weights.resize(other.size());
+    endgame_weights.resize(other.size());
+#endif
+    keys = other.keys;
+    white_to_moves = other.white_to_moves;
+    offsets.resize(other.offsets.size());
+    coefficients.resize(other.coefficients.size());
+    dense_indices = other.dense_indices;
+    dense_coefficients.resize(other.dense_coefficients.size());
+}
+
+template<typename Scalar>
+template<typename OtherScalar>
+void BasicEntryList<Scalar>::copy_range(const BasicEntryList<OtherScalar>& other, const size_t first_entry, const size_t last_entry)
+{
+    const auto copy_column = [first_entry, last_entry](const auto& source, auto& target)
+    {
+        transform(source.begin() + first_entry, source.begin() + last_entry, target.begin() + first_entry, [](const OtherScalar value)
+        {
+            return static_cast<Scalar>(value);
+        });
+    };
+    copy_column(other.wdls, wdls);
+    copy_column(other.weights, weights);
+    copy_column(other.additional_scores, additional_scores);
+#if TAPERED
+    copy_column(other.midgame_weights, midgame_weights);
+    copy_column(other.endgame_weights, endgame_weights);
+#endif
+
+    // The range that ends the list also copies the closing offset
+    const auto offset_end = last_entry == other.size() ? last_entry + 1 : last_entry;
+    copy(other.offsets.begin() + first_entry, other.offsets.begin() + offset_end, offsets.begin() + first_entry);
+    copy(other.coefficients.begin() + other.offsets[first_entry], other.coefficients.begin() + other.offsets[last_entry], coefficients.begin() + other.offsets[first_entry]);
+
+    const auto dense_size = other.dense_indices.size();
+    copy(other.dense_coefficients.begin() + first_entry * dense_size, other.dense_coefficients.begin() + last_entry * dense_size, dense_coefficients.begin() + first_entry * dense_size);
+}
+
+template<typename Scalar>
+void BasicEntryList<Scalar>::push_back(const Entry& entry, const span<const CoefficientEntry> entry_coefficients)
+{
+    if (!dense_indices.empty())
+    {
+        throw runtime_error("Entries can not be added after dense coefficients were promoted");
+    }
+
+    wdls.push_back(static_cast<Scalar>(entry.wdl));
+    weights.push_back(static_cast<Scalar>(entry.weight));
+    additional_scores.push_back(static_cast<Scalar>(entry.additional_score));
+#if TAPERED
+    midgame_weights.push_back(static_cast<Scalar>(entry.midgame_weight));
+    endgame_weights.push_back(static_cast<Scalar>(entry.endgame_weight));
+#endif
+    keys.push_back(entry.key);
+    white_to_moves.push_back(entry.white_to_move);
+
+    encode_coefficients(entry_coefficients, coefficients);
+    offsets.push_back(coefficients.size());
+}
+
+template<typename Scalar>
+void BasicEntryList<Scalar>::push_back_encoded(const Entry& entry, const span<const CoefficientWord> encoded_coefficients)
+{
+    push_back(entry, {});
+    coefficients.insert(coefficients.end(), encoded_coefficients.begin(), encoded_coefficients.end());
+    offsets.back() = coefficients.size();
+}
+
+template<typename Scalar>
+void BasicEntryList<Scalar>::append(const BasicEntryList& other)
+{
+    append(other, 0, other.size());
+}
+
+template<typename Scalar>
+void BasicEntryList<Scalar>::append(const BasicEntryList& other, const size_t first_entry, const size_t last_entry)
+{
+    if (!dense_indices.empty() || !other.dense_indices.empty())
+    {
+        throw runtime_error("Entries can not be added after dense coefficients were promoted");
+    }
+
+    const auto append_column = [first_entry, last_entry](auto& column, const auto& other_column)
+    {
+        column.insert(column.end(), other_column.begin() + first_entry, other_column.begin() + last_entry);
+    };
+    append_column(wdls, other.wdls);
+    append_column(weights, other.weights);
+    append_column(additional_scores, other.additional_scores);
+#if TAPERED
+    append_column(midgame_weights, other.midgame_weights);
+    append_column(endgame_weights, other.endgame_weights);
+#endif
+    append_column(keys, other.keys);
+    append_column(white_to_moves, other.white_to_moves);
+
+    const auto base = coefficients.size();
+    const auto other_base = other.offsets[first_entry];
+    coefficients.insert(coefficients.end(), other.coefficients.begin() + other_base, other.coefficients.begin() + other.offsets[last_entry]);
+    offsets.reserve(offsets.size() + last_entry - first_entry);
+    for (auto entry_index = first_entry + 1; entry_index <= last_entry; entry_index++)
+    {
+        offsets.push_back(base + (other.offsets[entry_index] - other_base));
+    }
+}
+
+template<typename Scalar>
+void BasicEntryList<Scalar>::append_columns(const EntryColumns& columns)
+{
+    if (!dense_indices.empty())
+    {
+        throw runtime_error("Entries can not be added after dense coefficients were promoted");
+    }
+
+    const auto append_column = [](auto& column, const auto& other_column)
+    {
+        column.insert(column.end(), other_column.begin(), other_column.end());
+    };
+    const auto entry_count = columns.wdls.size();
+    append_column(wdls, columns.wdls);
+    weights.insert(weights.end(), entry_count, static_cast<Scalar>(1));
+    append_column(additional_scores, columns.additional_scores);
+#if TAPERED
+    append_column(midgame_weights, columns.midgame_weights);
+    append_column(endgame_weights, columns.endgame_weights);
+#endif
+    append_column(keys, columns.keys);
+    append_column(white_to_moves, columns.white_to_moves);
+
+    const auto first_offset = coefficients.size();
+    offsets.reserve(offsets.size() + entry_count);
+    for (size_t entry_index = 1; entry_index <= entry_count; entry_index++)
+    {
+        offsets.push_back(first_offset + columns.offsets[entry_index]);
+    }
+    append_column(coefficients, columns.coefficients);
+}
+
+template<typename Scalar>
+void BasicEntryList<Scalar>::truncate(const size_t entry_count)
+{
+    if (entry_count >= size())
+    {
+        return;
+    }
+
+    for_each_column([entry_count](auto& column) { column.resize(entry_count); });
+    offsets.resize(entry_count + 1);
+    coefficients.resize(offsets.back());
+    dense_coefficients.resize(entry_count * dense_indices.size());
+}
+
+template<typename Scalar>
+void BasicEntryList<Scalar>::erase(const vector<bool>& erased)
+{
+    // Kept entries only ever move towards the front, so copying in place is safe
+    for_each_column([&erased](auto& column)
+    {
+        size_t kept_count = 0;
+        for (size_t entry_index = 0; entry_index < column.size(); entry_index++)
+        {
+            if (!erased[entry_index])
+            {
+                column[kept_count] = column[entry_index];
+                kept_count++;
+            }
+        }
+        column.resize(kept_count);
+    });
+
+    const auto dense_size = dense_indices.size();
+    size_t kept_count = 0;
+    size_t kept_coefficient_size = 0;
+    for (size_t entry_index = 0; entry_index + 1 < offsets.size(); entry_index++)
+    {
+        if (erased[entry_index])
+        {
+            continue;
+        }
+
+        const auto first = coefficients.begin() + offsets[entry_index];
+        const auto last = coefficients.begin() + offsets[entry_index + 1];
+        copy(first, last, coefficients.begin() + kept_coefficient_size);
+        kept_coefficient_size += last - first;
+
+        const auto dense_first = dense_coefficients.begin() + entry_index * dense_size;
+        copy(dense_first, dense_first + dense_size, dense_coefficients.begin() + kept_count * dense_size);
+
+        kept_count++;
+        offsets[kept_count] = kept_coefficient_size;
+    }
+
+    offsets.resize(kept_count + 1);
+    coefficients.resize(kept_coefficient_size);
+    dense_coefficients.resize(kept_count * dense_size);
+}
+
+template<typename Scalar>
+void BasicEntryList<Scalar>::clear()
+{
+    for_each_column([](auto& column) { column.clear(); });
+    offsets.assign(1, 0);
+    coefficients.clear();
+    dense_indices.clear();
+    dense_coefficients.clear();
+}
+
+template<typename Scalar>
+void BasicEntryList<Scalar>::promote_dense(const span<const uint32_t> indices)
+{
+    if (!dense_indices.empty())
+    {
+        throw runtime_error("Dense coefficients were already promoted");
+    }
+
+    const auto dense_size = indices.size();
+    column_t<int16_t> promoted(size() * dense_size, 0);
+    column_t<uint64_t> sparse_offsets;
+    sparse_offsets.reserve(offsets.size());
+    sparse_offsets.push_back(0);
+    column_t<CoefficientWord> sparse_coefficients;
+    sparse_coefficients.reserve(coefficients.size());
+
+    vector<CoefficientEntry> remaining;
+    for (size_t entry_index = 0; entry_index < size(); entry_index++)
+    {
+        const auto dense_row = promoted.data() + entry_index * dense_size;
+        size_t slot = 0;
+        remaining.clear();
+        decode_coefficients<int32_t>(coefficients.data() + offsets[entry_index], coefficients.data() + offsets[entry_index + 1], [&](const size_t index, const int32_t value)
+        {
+            while (slot < dense_size && indices[slot] < index)
+            {
+                slot++;
+            }
+
+            if (slot < dense_size && indices[slot] == index)
+            {
+                dense_row[slot] = static_cast<int16_t>(value);
+            }
+            else
+            {
+                remaining.push_back(CoefficientEntry{static_cast<int16_t>(value), static_cast<int32_t>(index)});
+            }
+        });
+
+        encode_coefficients(remaining, sparse_coefficients);
+        sparse_offsets.push_back(sparse_coefficients.size());
+    }
+
+    dense_indices.assign(indices.begin(), indices.end());
+    dense_coefficients = std::move(promoted);
+    offsets = std::move(sparse_offsets);
+    coefficients = std::move(sparse_coefficients);
+}
+
+template<typename Scalar>
+size_t BasicEntryList<Scalar>::get_kernel_memory_size() const
+{
+    constexpr size_t scalar_column_count = TAPERED ? 5 : 3;
+    return size() * (scalar_column_count * sizeof(Scalar) + sizeof(uint64_t)) + coefficients.size() * sizeof(CoefficientWord);
+}
+
+template<typename Scalar>
+void BasicEntryList<Scalar>::write_kernel_columns(ostream& stream, const size_t first_entry, const size_t last_entry) const
+{
+    if (!dense_indices.empty())
+    {
+        throw runtime_error("Entries with dense coefficients can not be written");
+    }
+
+    const auto write = [&stream](const auto* data, const size_t count)
+    {
+        stream.write(reinterpret_cast<const char*>(data), count * sizeof(*data));
+    };
+    const auto entry_count = last_entry - first_entry;
+    write(wdls.data() + first_entry, entry_count);
+    write(weights.data() + first_entry, entry_count);
+    write(additional_scores.data() + first_entry, entry_count);
+#if TAPERED
+    write(midgame_weights.data() + first_entry, entry_count);
+    write(endgame_weights.data() + first_entry, entry_count);
+#endif
+
+    column_t<uint64_t> rebased_offsets(offsets.begin() + first_entry, offsets.begin() + last_entry + 1);
+    for (auto& offset : rebased_offsets)
+    {
+        offset -= offsets[first_entry];
+    }
+    write(rebased_offsets.data(), rebased_offsets.size());
+    write(coefficients.data() + offsets[first_entry], offsets[last_entry] - offsets[first_entry]);
+}
+
+template<typename Scalar>
+void BasicEntryList<Scalar>::read_kernel_columns(istream& stream, const size_t entry_count, const size_t encoded_coefficient_size)
+{
+    const auto read = [&stream](auto& column, const size_t count)
+    {
+        column.resize(count);
+        stream.read(reinterpret_cast<char*>(column.data()), count * sizeof(column[0]));
+    };
+    read(wdls, entry_count);
+    read(weights, entry_count);
+    read(additional_scores, entry_count);
+#if TAPERED
+    read(midgame_weights, entry_count);
+    read(endgame_weights, entry_count);
+#endif
+    read(offsets, entry_count + 1);
+    read(coefficients, encoded_coefficient_size);
+    keys.clear();
+    white_to_moves.clear();
+    dense_indices.clear();
+    dense_coefficients.clear();
+}
+
+template<typename Scalar>
+void BasicEntryList<Scalar>::renumber_parameters(const span<const uint32_t> new_indices)
+{
+    column_t<uint64_t> renumbered_offsets;
+    renumbered_offsets.reserve(offsets.size());
+    renumbered_offsets.push_back(0);
+    column_t<CoefficientWord> renumbered_coefficients;
+    renumbered_coefficients.reserve(coefficients.size());
+
+    vector<CoefficientEntry> renumbered;
+    for (size_t entry_index = 0; entry_index < size(); entry_index++)
+    {
+        renumbered.clear();
+        decode_coefficients<int32_t>(coefficients.data() + offsets[entry_index], coefficients.data() + offsets[entry_index + 1], [&](const size_t index, const int32_t value)
+        {
+            renumbered.push_back(CoefficientEntry{static_cast<int16_t>(value), static_cast<int32_t>(new_indices[index])});
+        });
+        sort(renumbered.begin(), renumbered.end(), [](const CoefficientEntry& left, const CoefficientEntry& right)
+        {
+            return left.index < right.index;
+        });
+
+        encode_coefficients(renumbered, renumbered_coefficients);
+        renumbered_offsets.push_back(renumbered_coefficients.size());
+    }
+
+    // Dense slots keep their order, only the parameter they stand for changes
+    for (auto& index : dense_indices)
+    {
+        index = new_indices[index];
+    }
+    offsets = std::move(renumbered_offsets);
+    coefficients = std::move(renumbered_coefficients);
+}
+
+template class BasicEntryList<double>;
+template class BasicEntryList<float>;
+template void BasicEntryList<double>::allocate_like(const BasicEntryList<double>& other);
+template void BasicEntryList<double>::copy_range(const BasicEntryList<double>& other, size_t first_entry, size_t last_entry);
+template void BasicEntryList<float>::allocate_like(const BasicEntryList<double>& other);
+template void BasicEntryList<float>::copy_range(const BasicEntryList<double>& other, size_t first_entry, size_t last_entry);
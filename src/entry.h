@@ -0,0 +1,320 @@
+#ifndef ENTRY_H
+#define ENTRY_H 1
+
+#include "config.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <new>
+#include <span>
+#include <utility>
+#include <vector>
+
+struct CoefficientEntry
+{
+    int16_t value;
+    int32_t index;
+};
+
+// Coefficients are stored sorted by index as 16-bit words, one word per coefficient:
+// bits 4-15 hold the index distance to the previous coefficient (to 0 for the first one),
+// bits 0-3 hold a value code, 1..8 for -8..-1 and 9..15 for 1..7.
+// A coefficient that does not fit is escaped on its own, the rest of its entry stays compact. Its first word has code 0
+// and bits 4-7 hold its value code, or 0 when the value follows as a word of its own. The full 32-bit distance comes
+// next as two words, high half first. An escaped coefficient takes three or four words.
+using CoefficientWord = uint16_t;
+constexpr uint32_t coefficient_max_distance = 4095;
+constexpr int32_t coefficient_min_value = -8;
+constexpr int32_t coefficient_max_value = 7;
+constexpr uint32_t coefficient_value_mask = 15;
+constexpr uint32_t coefficient_escape_code = 0;
+
+// Decoded value of each code, already in the scalar type of the kernel so decoding needs no conversion
+template<typename Scalar>
+inline constexpr Scalar coefficient_values[16] = {0, -8, -7, -6, -5, -4, -3, -2, -1, 1, 2, 3, 4, 5, 6, 7};
+
+inline bool is_escaped_coefficient(const CoefficientWord word)
+{
+    return (word & coefficient_value_mask) == coefficient_escape_code;
+}
+
+// Decodes the escaped coefficient at cursor, adds its distance to index and returns the position past its words
+template<typename Scalar>
+inline const CoefficientWord* decode_escaped_coefficient(const CoefficientWord* const cursor, size_t& index, Scalar& value)
+{
+    const uint32_t word = cursor[0];
+    index += (static_cast<size_t>(cursor[1]) << 16) | cursor[2];
+    const auto value_code = (word >> 4) & coefficient_value_mask;
+    if (value_code != coefficient_escape_code)
+    {
+        value = coefficient_values<Scalar>[value_code];
+        return cursor + 3;
+    }
+    value = static_cast<Scalar>(static_cast<int16_t>(cursor[3]));
+    return cursor + 4;
+}
+
+// Decodes the coefficient at cursor, compact or escaped, adds its distance to index and returns the position past its words
+template<typename Scalar>
+inline const CoefficientWord* decode_coefficient(const CoefficientWord* const cursor, size_t& index, Scalar& value)
+{
+    const uint32_t word = *cursor;
+    if (is_escaped_coefficient(word)) [[unlikely]]
+    {
+        return decode_escaped_coefficient(cursor, index, value);
+    }
+    index += word >> 4;
+    value = coefficient_values<Scalar>[word & coefficient_value_mask];
+    return cursor + 1;
+}
+
+// Calls function(index, value) for each coefficient of an encoded entry, in index order
+template<typename Scalar, typename Function>
+inline void decode_coefficients(const CoefficientWord* cursor, const CoefficientWord* const end, Function function)
+{
+    size_t index = 0;
+    while (cursor < end)
+    {
+        Scalar value;
+        cursor = decode_coefficient(cursor, index, value);
+        function(index, value);
+    }
+}
+
+// Position within the encoded coefficients of one entry, lets them be decoded in consecutive index ranges
+struct CoefficientCursor
+{
+    const CoefficientWord* position;
+    const CoefficientWord* end;
+    // Index of the last decoded coefficient, the next distance is relative to it
+    size_t index;
+};
+
+inline CoefficientCursor get_coefficient_cursor(const CoefficientWord* const begin, const CoefficientWord* const end)
+{
+    return CoefficientCursor{begin, end, 0};
+}
+
+// Calls function(index, value) for the coefficients after the cursor with an index below index_end and advances past them
+template<typename Scalar, typename Function>
+inline void decode_coefficients_below(CoefficientCursor& cursor, const size_t index_end, Function function)
+{
+    while (cursor.position < cursor.end)
+    {
+        auto index = cursor.index;
+        Scalar value;
+        const auto next = decode_coefficient(cursor.position, index, value);
+        if (index >= index_end)
+        {
+            return;
+        }
+        cursor.position = next;
+        cursor.index = index;
+        function(index, value);
+    }
+}
+
+// A single position as it is built while loading, stored column by column in an EntryList
+struct Entry
+{
+    tune_t wdl;
+    // Number of loaded positions this entry stands for, above 1 once duplicates are merged into it
+    tune_t weight = 1;
+    // Zobrist key of the position the coefficients were taken from
+    uint64_t key;
+    bool white_to_move;
+    //tune_t initial_eval;
+    tune_t additional_score;
+#if TAPERED
+    // phase / 24, and (24 - phase) / 24 with the endgame scale of the eval folded in
+    tune_t midgame_weight;
+    tune_t endgame_weight;
+#endif
+};
+
+// Columns of entries held outside an entry list, such as a mapped entry cache. The offsets have a leading zero, one more
+// value than there are entries. Weights are not stored, the entries count one position each.
+struct EntryColumns
+{
+    std::span<const tune_t> wdls;
+    std::span<const tune_t> additional_scores;
+    std::span<const tune_t> midgame_weights;
+    std::span<const tune_t> endgame_weights;
+    std::span<const uint64_t> keys;
+    std::span<const uint8_t> white_to_moves;
+    std::span<const uint64_t> offsets;
+    std::span<const CoefficientWord> coefficients;
+};
+
+constexpr size_t entry_column_alignment = 64;
+
+// Columns of at least a huge page are aligned to one and, with use_huge_pages, advised to be backed by transparent huge pages
+void* allocate_column(size_t size);
+void free_column(void* pointer, size_t size);
+
+// Starts every entry column on its own cache line.
+// Elements added by resize are left uninitialized, so a column is first written, and its pages placed, by whoever fills it.
+template<typename T>
+struct ColumnAllocator
+{
+    using value_type = T;
+
+    ColumnAllocator() = default;
+    template<typename U>
+    ColumnAllocator(const ColumnAllocator<U>&) {}
+
+    T* allocate(const size_t count)
+    {
+        return static_cast<T*>(allocate_column(count * sizeof(T)));
+    }
+
+    void deallocate(T* pointer, const size_t count)
+    {
+        free_column(pointer, count * sizeof(T));
+    }
+
+    template<typename U>
+    void construct(U* pointer)
+    {
+        ::new (static_cast<void*>(pointer)) U;
+    }
+
+    template<typename U, typename... Args>
+    void construct(U* pointer, Args&&... args)
+    {
+        ::new (static_cast<void*>(pointer)) U(std::forward<Args>(args)...);
+    }
+
+    template<typename U>
+    bool operator==(const ColumnAllocator<U>&) const { return true; }
+};
+
+template<typename T>
+using column_t = std::vector<T, ColumnAllocator<T>>;
+
+// Entries stored as one column per field, with the encoded coefficients of all of them in one flat array.
+// Entry i owns coefficient words [offsets[i], offsets[i + 1]).
+// Coefficients present in nearly every entry can be promoted to a dense block, where every entry stores a value
+// for each promoted parameter in slot order, zeros included, and only the rest stays in the sparse encoding.
+// The epoch kernels only walk the columns they read, the key and side to move columns are only used while loading and for statistics.
+// Scalar is the type of the wdl, weight, additional score and phase weight columns.
+template<typename Scalar>
+class BasicEntryList {
+public:
+    BasicEntryList() = default;
+
+    size_t size() const { return wdls.size(); }
+    bool empty() const { return wdls.empty(); }
+    // Number of words the coefficients of all entries are encoded in
+    size_t encoded_coefficient_size() const { return coefficients.size(); }
+
+    std::span<Scalar> get_wdls() { return wdls; }
+    std::span<const Scalar> get_wdls() const { return wdls; }
+    std::span<Scalar> get_weights() { return weights; }
+    std::span<const Scalar> get_weights() const { return weights; }
+    std::span<const Scalar> get_additional_scores() const { return additional_scores; }
+#if TAPERED
+    std::span<const Scalar> get_midgame_weights() const { return midgame_weights; }
+    std::span<const Scalar> get_endgame_weights() const { return endgame_weights; }
+#endif
+    std::span<const uint64_t> get_keys() const { return keys; }
+    std::span<const uint8_t> get_white_to_moves() const { return white_to_moves; }
+
+    // Parameter index of each dense slot
+    std::span<const uint32_t> get_dense_indices() const { return dense_indices; }
+    // Dense coefficient values of the entry, one per slot
+    std::span<const int16_t> get_dense_coefficients(const size_t index) const
+    {
+        return {dense_coefficients.data() + index * dense_indices.size(), dense_indices.size()};
+    }
+
+    // Calls function(index, value) for each coefficient of the entry
+    template<typename Function>
+    void for_each_coefficient(const size_t index, Function function) const
+    {
+        decode_coefficients<Scalar>(coefficients.data() + offsets[index], coefficients.data() + offsets[index + 1], function);
+    }
+
+    CoefficientCursor get_coefficient_cursor(const size_t index) const
+    {
+        return ::get_coefficient_cursor(coefficients.data() + offsets[index], coefficients.data() + offsets[index + 1]);
+    }
+
+    // Encoded coefficients of entries [first_entry, last_entry) in one span
+    std::span<const CoefficientWord> get_encoded_coefficients(const size_t first_entry, const size_t last_entry) const
+    {
+        return {coefficients.data() + offsets[first_entry], coefficients.data() + offsets[last_entry]};
+    }
+
+    const column_t<uint64_t>& get_offsets() const { return offsets; }
+
+    void reserve(size_t entry_count, size_t encoded_coefficient_size);
+    // Sizes the columns for the entries of other without writing to them, they are then filled range by range with
+    // copy_range, converting the scalar columns. Each range ends up on the NUMA node of the thread that copies it.
+    template<typename OtherScalar>
+    void allocate_like(const BasicEntryList<OtherScalar>& other);
+    template<typename OtherScalar>
+    void copy_range(const BasicEntryList<OtherScalar>& other, size_t first_entry, size_t last_entry);
+    void push_back(const Entry& entry, std::span<const CoefficientEntry> entry_coefficients);
+    void push_back_encoded(const Entry& entry, std::span<const CoefficientWord> encoded_coefficients);
+    void append(const BasicEntryList& other);
+    void append(const BasicEntryList& other, size_t first_entry, size_t last_entry);
+    // Appends whole columns at once, the TAPERED weights are ignored when TAPERED is off
+    void append_columns(const EntryColumns& columns);
+    void truncate(size_t entry_count);
+    // Removes the marked entries and their coefficients, keeping the order of the rest
+    void erase(const std::vector<bool>& erased);
+    void clear();
+    // Moves the coefficients of the given parameters, sorted by index, out of the sparse encoding into the dense block.
+    // Done once all entries are loaded, entries can not be pushed afterwards.
+    void promote_dense(std::span<const uint32_t> indices);
+    // Bytes taken by the columns the epoch kernels read
+    size_t get_kernel_memory_size() const;
+    // Writes the columns the epoch kernels read for entries [first_entry, last_entry), with the offsets rebased to the first of them.
+    // Only lists without dense coefficients can be written.
+    void write_kernel_columns(std::ostream& stream, size_t first_entry, size_t last_entry) const;
+    // Replaces the entries with ones written by write_kernel_columns, the key and side to move columns are left empty.
+    // Columns keep their capacity, so reading into the same list again does not allocate.
+    void read_kernel_columns(std::istream& stream, size_t entry_count, size_t encoded_coefficient_size);
+    // Replaces every parameter index i, sparse and dense, with new_indices[i] and re-encodes the entries in the new order
+    void renumber_parameters(std::span<const uint32_t> new_indices);
+
+private:
+    template<typename OtherScalar>
+    friend class BasicEntryList;
+
+    column_t<Scalar> wdls;
+    column_t<Scalar> weights;
+    column_t<Scalar> additional_scores;
+#if TAPERED
+    column_t<Scalar> midgame_weights;
+    column_t<Scalar> endgame_weights;
+#endif
+    std::vector<uint64_t> keys;
+    std::vector<uint8_t> white_to_moves;
+    column_t<uint64_t> offsets = {0};
+    column_t<CoefficientWord> coefficients;
+    std::vector<uint32_t> dense_indices;
+    column_t<int16_t> dense_coefficients;
+
+    // Applies function to every per-entry column, offsets and coefficients are handled separately
+    template<typename Function>
+    void for_each_column(Function function)
+    {
+        function(wdls);
+        function(weights);
+        function(additional_scores);
+#if TAPERED
+        function(midgame_weights);
+        function(endgame_weights);
+#endif
+        function(keys);
+        function(white_to_moves);
+    }
+};
+
+// Entries as they are loaded, deduplicated and cached
+using EntryList = BasicEntryList<tune_t>;
+
+#endif // !ENTRY_H
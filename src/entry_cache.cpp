@@ -0,0 +1,242 @@
+#include "entry_cache.h"
+#include "mapped_file.h"
+
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+using namespace Tuner;
+
+// Cache layout: header, then one 8-byte aligned column per entry field, then the coefficient offsets and the coefficients
+constexpr uint64_t cache_magic = 0x4548434143525854ull; // "TXRCACHE"
+constexpr uint32_t cache_version = 8;
+constexpr size_t cache_alignment = 8;
+
+enum EntryCacheFlags : uint32_t
+{
+    Tapered = 1 << 0,
+    AdditionalScore = 1 << 1,
+    Qsearch = 1 << 2,
+    FilterInCheck = 1 << 3,
+    SideToMoveWdl = 1 << 4,
+    PositionKeys = 1 << 5,
+};
+
+struct EntryCacheHeader
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t scalar_size;
+    EntryCacheKey key;
+    uint64_t entry_count;
+    uint64_t coefficient_size;
+};
+
+static size_t align_size(const size_t size)
+{
+    return (size + cache_alignment - 1) / cache_alignment * cache_alignment;
+}
+
+static size_t get_cache_size(const uint64_t entry_count, const uint64_t coefficient_size)
+{
+    size_t size = sizeof(EntryCacheHeader);
+    size += align_size(entry_count * sizeof(tune_t)); // wdl
+    size += align_size(entry_count * sizeof(tune_t)); // additional_score
+    size += align_size(entry_count * sizeof(tune_t)); // midgame_weight
+    size += align_size(entry_count * sizeof(tune_t)); // endgame_weight
+    size += align_size(entry_count * sizeof(uint8_t)); // white_to_move
+    size += align_size(entry_count * sizeof(uint64_t)); // key
+    size += align_size((entry_count + 1) * sizeof(uint64_t)); // coefficient offsets
+    size += align_size(coefficient_size * sizeof(CoefficientWord)); // encoded coefficients
+    return size;
+}
+
+template<typename T>
+static void write_column(ofstream& file, const span<const T> column)
+{
+    file.write(reinterpret_cast<const char*>(column.data()), column.size() * sizeof(T));
+
+    const auto written = column.size() * sizeof(T);
+    const char padding[cache_alignment] = {};
+    file.write(padding, align_size(written) - written);
+}
+
+template<typename T>
+static const T* read_column(const char*& cursor, const size_t count)
+{
+    const auto column = reinterpret_cast<const T*>(cursor);
+    cursor += align_size(count * sizeof(T));
+    return column;
+}
+
+string Tuner::get_entry_cache_path(const DataSource& source)
+{
+    return source.path + ".cache";
+}
+
+EntryCacheKey Tuner::get_entry_cache_key(const DataSource& source, const parameters_t& parameters)
+{
+    EntryCacheKey key{};
+
+    error_code size_error;
+    error_code time_error;
+    const auto size = filesystem::file_size(source.path, size_error);
+    const auto modified_time = filesystem::last_write_time(source.path, time_error);
+    if (size_error || time_error)
+    {
+        cout << "Failed to open " << source.path << endl;
+        throw runtime_error("Failed to open data source");
+    }
+    key.source_modified_time = modified_time.time_since_epoch().count();
+    key.source_size = size;
+
+    const array<int64_t, 4> format_options = {static_cast<int64_t>(source.format), pgn_skip_plies, pgn_sample_interval, pgn_filter_noisy};
+    const auto format_option_count = source.format == DataFormat::Pgn ? format_options.size() : 1;
+    key.format_hash = hash_bytes(format_options.data(), format_option_count * sizeof(int64_t));
+
+    // additional_score depends on the initial parameter values, not only on the layout
+    key.parameters_hash = hash_bytes(parameters.data(), parameters.size() * sizeof(parameters_t::value_type));
+    key.parameter_count = parameters.size();
+    key.position_limit = source.position_limit;
+
+    key.flags |= TAPERED ? static_cast<uint32_t>(Tapered) : 0u;
+    key.flags |= TuneEval::includes_additional_score ? static_cast<uint32_t>(AdditionalScore) : 0u;
+    key.flags |= TuneEval::enable_qsearch ? static_cast<uint32_t>(Qsearch) : 0u;
+    key.flags |= TuneEval::filter_in_check ? static_cast<uint32_t>(FilterInCheck) : 0u;
+    key.flags |= source.side_to_move_wdl ? static_cast<uint32_t>(SideToMoveWdl) : 0u;
+    // The FEN fast path only computes position keys when they are needed for deduplication
+    key.flags |= enable_deduplication ? static_cast<uint32_t>(PositionKeys) : 0u;
+
+    return key;
+}
+
+bool Tuner::load_entry_cache(const string& path, const EntryCacheKey& key, EntryList& entries)
+{
+    MappedFile file;
+    if (!file.open(path))
+    {
+        return false;
+    }
+
+    EntryCacheHeader header;
+    if (file.size() < sizeof(header))
+    {
+        cout << "Entry cache " << path << " is truncated, ignoring it" << endl;
+        return false;
+    }
+    memcpy(&header, file.data(), sizeof(header));
+
+    if (header.magic != cache_magic || header.version != cache_version || header.scalar_size != sizeof(tune_t))
+    {
+        cout << "Entry cache " << path << " has an unsupported format, ignoring it" << endl;
+        return false;
+    }
+
+    if (header.key != key)
+    {
+        cout << "Entry cache " << path << " is stale, ignoring it" << endl;
+        return false;
+    }
+
+    if (file.size() != get_cache_size(header.entry_count, header.coefficient_size))
+    {
+        cout << "Entry cache " << path << " is truncated, ignoring it" << endl;
+        return false;
+    }
+
+    const auto entry_count = header.entry_count;
+    const char* cursor = file.data() + sizeof(header);
+    const auto wdls = read_column<tune_t>(cursor, entry_count);
+    const auto additional_scores = read_column<tune_t>(cursor, entry_count);
+    const auto midgame_weights = read_column<tune_t>(cursor, entry_count);
+    const auto endgame_weights = read_column<tune_t>(cursor, entry_count);
+    const auto white_to_moves = read_column<uint8_t>(cursor, entry_count);
+    const auto keys = read_column<uint64_t>(cursor, entry_count);
+    const auto offsets = read_column<uint64_t>(cursor, entry_count + 1);
+    const auto coefficients = read_column<CoefficientWord>(cursor, header.coefficient_size);
+
+    if (offsets[0] != 0 || offsets[entry_count] != header.coefficient_size)
+    {
+        cout << "Entry cache " << path << " is corrupt, ignoring it" << endl;
+        return false;
+    }
+
+    EntryColumns columns;
+    columns.wdls = {wdls, entry_count};
+    columns.additional_scores = {additional_scores, entry_count};
+    columns.midgame_weights = {midgame_weights, entry_count};
+    columns.endgame_weights = {endgame_weights, entry_count};
+    columns.keys = {keys, entry_count};
+    columns.white_to_moves = {white_to_moves, entry_count};
+    columns.offsets = {offsets, entry_count + 1};
+    columns.coefficients = {coefficients, header.coefficient_size};
+    entries.append_columns(columns);
+
+    return true;
+}
+
+void Tuner::save_entry_cache(const string& path, const EntryCacheKey& key, const EntryList& entries, const size_t first_entry)
+{
+    // Written under a temporary name and renamed, so an interrupted run never leaves a half written cache behind
+    const auto temporary_path = path + ".tmp";
+    ofstream file(temporary_path, ios::binary | ios::trunc);
+    if (!file)
+    {
+        cout << "Failed to create entry cache " << path << endl;
+        return;
+    }
+
+    EntryCacheHeader header{};
+    header.magic = cache_magic;
+    header.version = cache_version;
+    header.scalar_size = sizeof(tune_t);
+    header.key = key;
+    header.entry_count = entries.size() - first_entry;
+    const auto coefficients = entries.get_encoded_coefficients(first_entry, entries.size());
+    header.coefficient_size = coefficients.size();
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    write_column(file, entries.get_wdls().subspan(first_entry));
+    write_column(file, entries.get_additional_scores().subspan(first_entry));
+#if TAPERED
+    write_column(file, entries.get_midgame_weights().subspan(first_entry));
+    write_column(file, entries.get_endgame_weights().subspan(first_entry));
+#else
+    const vector<tune_t> unused_weights(header.entry_count);
+    write_column<tune_t>(file, unused_weights);
+    write_column<tune_t>(file, unused_weights);
+#endif
+    write_column(file, entries.get_white_to_moves().subspan(first_entry));
+    write_column(file, entries.get_keys().subspan(first_entry));
+
+    // Offsets have a leading zero, entry_count + 1 values in total, rebased to the first written entry
+    const auto& offsets = entries.get_offsets();
+    const auto first_offset = offsets[first_entry];
+    vector<uint64_t> rebased_offsets(offsets.begin() + first_entry, offsets.end());
+    for (auto& offset : rebased_offsets)
+    {
+        offset -= first_offset;
+    }
+    write_column<uint64_t>(file, rebased_offsets);
+    write_column(file, coefficients);
+
+    file.close();
+    if (!file)
+    {
+        cout << "Failed to write entry cache " << path << endl;
+        remove(temporary_path.c_str());
+        return;
+    }
+
+    remove(path.c_str());
+    if (rename(temporary_path.c_str(), path.c_str()) != 0)
+    {
+        cout << "Failed to write entry cache " << path << endl;
+        remove(temporary_path.c_str());
+    }
+}
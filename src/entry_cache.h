@@ -0,0 +1,36 @@
+#ifndef ENTRY_CACHE_H
+#define ENTRY_CACHE_H 1
+
+#include "config.h"
+#include "entry.h"
+#include "tuner.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Tuner
+{
+    // Everything the parsed entries of a source depend on, a cache with a different key is stale.
+    // The source itself is identified by its size and modification time, so checking the key never reads it.
+    struct EntryCacheKey
+    {
+        int64_t source_modified_time;
+        uint64_t source_size;
+        uint64_t format_hash;
+        uint64_t parameters_hash;
+        uint64_t parameter_count;
+        int64_t position_limit;
+        uint32_t flags;
+        uint32_t reserved;
+
+        bool operator==(const EntryCacheKey&) const = default;
+    };
+
+    std::string get_entry_cache_path(const DataSource& source);
+    EntryCacheKey get_entry_cache_key(const DataSource& source, const parameters_t& parameters);
+    bool load_entry_cache(const std::string& path, const EntryCacheKey& key, EntryList& entries);
+    void save_entry_cache(const std::string& path, const EntryCacheKey& key, const EntryList& entries, size_t first_entry);
+}
+
+#endif // !ENTRY_CACHE_H
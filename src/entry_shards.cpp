@@ -0,0 +1,229 @@
+#include "entry_shards.h"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <system_error>
+
+using namespace std;
+using namespace std::chrono;
+using namespace Tuner;
+
+// Shard layout: header, then the kernel columns as written by BasicEntryList::write_kernel_columns
+constexpr uint64_t shard_magic = 0x4452414853525854ull; // "TXRSHARD"
+constexpr uint32_t shard_version = 1;
+
+struct EntryShardHeader
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t scalar_size;
+    uint32_t tapered;
+    uint32_t reserved;
+    uint64_t entry_count;
+    uint64_t coefficient_size;
+};
+
+EntryShards::EntryShards(const string& directory, const size_t memory_limit) : directory(directory), shard_memory_size(max<size_t>(memory_limit / 2, 1))
+{
+    error_code error;
+    filesystem::create_directories(directory, error);
+    if (error)
+    {
+        cout << "Failed to create shard directory " << directory << ": " << error.message() << endl;
+        throw runtime_error("Failed to create shard directory");
+    }
+    reader_pool.start(1);
+}
+
+EntryShards::~EntryShards()
+{
+    reader_pool.stop();
+    for (size_t shard_index = 0; shard_index < shard_sizes.size(); shard_index++)
+    {
+        error_code error;
+        filesystem::remove(get_shard_path(shard_index), error);
+    }
+
+    // Only removed if nothing else was put there
+    error_code error;
+    filesystem::remove(directory, error);
+}
+
+void EntryShards::append(const EntryList& entries)
+{
+    for (const auto weight : entries.get_weights())
+    {
+        total_weight += weight;
+    }
+    entry_count += entries.size();
+
+    // Shards are written straight from entries where possible, only the start of a shard begun by an earlier call is copied
+    constexpr size_t entry_column_size = (TAPERED ? 5 : 3) * sizeof(tune_t) + sizeof(uint64_t);
+    const auto& offsets = entries.get_offsets();
+    auto shard_size = pending.get_kernel_memory_size();
+    size_t first_entry = 0;
+    for (size_t entry_index = 0; entry_index < entries.size(); entry_index++)
+    {
+        shard_size += entry_column_size + (offsets[entry_index + 1] - offsets[entry_index]) * sizeof(CoefficientWord);
+        if (shard_size < shard_memory_size)
+        {
+            continue;
+        }
+
+        const auto last_entry = entry_index + 1;
+        if (pending.empty())
+        {
+            write_shard(entries, first_entry, last_entry);
+        }
+        else
+        {
+            pending.append(entries, first_entry, last_entry);
+            write_shard(pending, 0, pending.size());
+            pending.clear();
+        }
+        first_entry = last_entry;
+        shard_size = 0;
+    }
+    pending.append(entries, first_entry, entries.size());
+}
+
+void EntryShards::finish()
+{
+    if (!pending.empty())
+    {
+        write_shard(pending, 0, pending.size());
+    }
+    pending = EntryList();
+}
+
+void EntryShards::for_each_shard(const function<void(const EntryList&)>& function)
+{
+    if (shard_sizes.empty())
+    {
+        return;
+    }
+
+    const auto pass_start = steady_clock::now();
+    auto buffer_index = first_shard_buffer;
+    if (!first_shard_ready)
+    {
+        read_shard(0, buffers[buffer_index]);
+        first_shard_ready = true;
+    }
+
+    if (shard_sizes.size() == 1)
+    {
+        function(buffers[buffer_index]);
+        pass_seconds += duration<double>(steady_clock::now() - pass_start).count();
+        return;
+    }
+
+    for (size_t shard_index = 0; shard_index < shard_sizes.size(); shard_index++)
+    {
+        const auto next_shard = (shard_index + 1) % shard_sizes.size();
+        const auto next_buffer = 1 - buffer_index;
+        exception_ptr read_error;
+        reader_pool.enqueue([&, next_shard, next_buffer]()
+        {
+            try
+            {
+                read_shard(next_shard, buffers[next_buffer]);
+            }
+            catch (...)
+            {
+                read_error = current_exception();
+            }
+        });
+
+        function(buffers[buffer_index]);
+
+        const auto wait_start = steady_clock::now();
+        reader_pool.wait_for_completion();
+        wait_seconds += duration<double>(steady_clock::now() - wait_start).count();
+        if (read_error)
+        {
+            rethrow_exception(read_error);
+        }
+        buffer_index = next_buffer;
+    }
+
+    first_shard_buffer = buffer_index;
+    pass_seconds += duration<double>(steady_clock::now() - pass_start).count();
+}
+
+void EntryShards::print_throughput()
+{
+    const auto megabytes = read_bytes / 1e6;
+    cout << "Streamed " << megabytes << " MB from " << shard_sizes.size() << " shards at " << (read_seconds > 0 ? megabytes / read_seconds : 0) << " MB/s, ";
+    cout << "waited " << wait_seconds << "s of " << pass_seconds << "s for reads" << endl;
+    read_bytes = 0;
+    read_seconds = 0;
+    wait_seconds = 0;
+    pass_seconds = 0;
+}
+
+string EntryShards::get_shard_path(const size_t shard_index) const
+{
+    return (filesystem::path(directory) / ("shard_" + to_string(shard_index) + ".bin")).string();
+}
+
+void EntryShards::write_shard(const EntryList& entries, const size_t first_entry, const size_t last_entry)
+{
+    const auto path = get_shard_path(shard_sizes.size());
+    ofstream file(path, ios::binary | ios::trunc);
+
+    EntryShardHeader header{};
+    header.magic = shard_magic;
+    header.version = shard_version;
+    header.scalar_size = sizeof(tune_t);
+    header.tapered = TAPERED;
+    header.entry_count = last_entry - first_entry;
+    header.coefficient_size = entries.get_offsets()[last_entry] - entries.get_offsets()[first_entry];
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    entries.write_kernel_columns(file, first_entry, last_entry);
+
+    file.close();
+    if (!file)
+    {
+        cout << "Failed to write shard " << path << endl;
+        throw runtime_error("Failed to write shard");
+    }
+    shard_sizes.push_back({header.entry_count, header.coefficient_size});
+}
+
+void EntryShards::read_shard(const size_t shard_index, EntryList& entries)
+{
+    const auto read_start = steady_clock::now();
+    const auto path = get_shard_path(shard_index);
+    ifstream file(path, ios::binary);
+
+    EntryShardHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    const auto& expected_size = shard_sizes[shard_index];
+    if (!file || header.magic != shard_magic || header.version != shard_version || header.entry_count != expected_size.entry_count || header.coefficient_size != expected_size.coefficient_size)
+    {
+        cout << "Shard " << path << " is missing or was modified" << endl;
+        throw runtime_error("Failed to read shard");
+    }
+
+    if (header.scalar_size != sizeof(tune_t) || header.tapered != TAPERED)
+    {
+        cout << "Shard " << path << " was written with a different tune_t or TAPERED setting" << endl;
+        throw runtime_error("Failed to read shard");
+    }
+
+    entries.read_kernel_columns(file, header.entry_count, header.coefficient_size);
+    if (!file)
+    {
+        cout << "Shard " << path << " is truncated" << endl;
+        throw runtime_error("Failed to read shard");
+    }
+
+    read_bytes += sizeof(header) + entries.get_kernel_memory_size();
+    read_seconds += duration<double>(steady_clock::now() - read_start).count();
+}
@@ -0,0 +1,77 @@
+#ifndef ENTRY_SHARDS_H
+#define ENTRY_SHARDS_H 1
+
+#include "config.h"
+#include "entry.h"
+#include "threadpool.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace Tuner
+{
+    // Entries written to shard files on disk and streamed back in order every pass, for training sets larger than memory.
+    // Only the columns the epoch kernels read are stored. Two shards are in memory while streaming, the one being
+    // computed on and the next one being read, so each shard is written once it reaches half the memory limit.
+    class EntryShards {
+    public:
+        EntryShards(const std::string& directory, size_t memory_limit);
+        ~EntryShards();
+        EntryShards(const EntryShards&) = delete;
+        EntryShards& operator=(const EntryShards&) = delete;
+
+        // Adds the entries to the shards and writes out every shard as soon as it fills up. Entries that do not fill
+        // a shard are kept until more arrive, so at most one shard's worth of entries is held here.
+        void append(const EntryList& entries);
+        // Writes the last, partially filled shard
+        void finish();
+
+        size_t size() const { return entry_count; }
+        size_t shard_count() const { return shard_sizes.size(); }
+        tune_t get_total_weight() const { return total_weight; }
+        // Shards hold no dense coefficients
+        std::span<const uint32_t> get_dense_indices() const { return {}; }
+
+        // Calls function with each shard in order, the next shard is read on the reader thread meanwhile.
+        // The last shard of a pass overlaps with reading the first shard of the next one, a single shard is read once and kept.
+        void for_each_shard(const std::function<void(const EntryList&)>& function);
+
+        // Read throughput and how long the computation waited for reads, since the last call
+        void print_throughput();
+
+    private:
+        struct ShardSize
+        {
+            uint64_t entry_count;
+            uint64_t coefficient_size;
+        };
+
+        std::string directory;
+        size_t shard_memory_size;
+        EntryList pending;
+        std::vector<ShardSize> shard_sizes;
+        size_t entry_count = 0;
+        tune_t total_weight = 0;
+        std::array<EntryList, 2> buffers;
+        // A pool of its own, the computation waits for the jobs of the shared pool and would wait for the read as well
+        ThreadPool reader_pool;
+        bool first_shard_ready = false;
+        size_t first_shard_buffer = 0;
+
+        uint64_t read_bytes = 0;
+        double read_seconds = 0;
+        double wait_seconds = 0;
+        double pass_seconds = 0;
+
+        std::string get_shard_path(size_t shard_index) const;
+        void write_shard(const EntryList& entries, size_t first_entry, size_t last_entry);
+        void read_shard(size_t shard_index, EntryList& entries);
+    };
+}
+
+#endif // !ENTRY_SHARDS_H
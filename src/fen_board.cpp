@@ -0,0 +1,61 @@
+#include "fen_board.h"
+
+using namespace std;
+using namespace Tuner;
+
+void FenBoard::set_tokens(const FenTokens& tokens)
+{
+    occ_bb_.fill(0ULL);
+    pieces_bb_.fill(0ULL);
+    board_.fill(chess::Piece::NONE);
+    cr_.clear();
+    prev_states_.clear();
+
+    // Ranks from 8 down to 1, as setFen reads them
+    int square = 56;
+    for (const char character : tokens.board)
+    {
+        if (character == '/')
+        {
+            square -= 16;
+        }
+        else if (character >= '1' && character <= '8')
+        {
+            square += character - '0';
+        }
+        else if (const auto piece = chess::Piece(string_view(&character, 1)); piece != chess::Piece::NONE && square >= 0 && square < 64)
+        {
+            placePiece(piece, chess::Square(square));
+            square++;
+        }
+    }
+
+    for (const char character : tokens.castling)
+    {
+        if (character == 'K')
+        {
+            cr_.setCastlingRight(chess::Color::WHITE, CastlingRights::Side::KING_SIDE, chess::File::FILE_H);
+        }
+        else if (character == 'Q')
+        {
+            cr_.setCastlingRight(chess::Color::WHITE, CastlingRights::Side::QUEEN_SIDE, chess::File::FILE_A);
+        }
+        else if (character == 'k')
+        {
+            cr_.setCastlingRight(chess::Color::BLACK, CastlingRights::Side::KING_SIDE, chess::File::FILE_H);
+        }
+        else if (character == 'q')
+        {
+            cr_.setCastlingRight(chess::Color::BLACK, CastlingRights::Side::QUEEN_SIDE, chess::File::FILE_A);
+        }
+    }
+
+    // A missing side to move field means white, as in setFen
+    const bool white_to_move = tokens.side_to_move.empty() || tokens.side_to_move == "w";
+    stm_ = white_to_move ? chess::Color::WHITE : chess::Color::BLACK;
+    ep_sq_ = tokens.en_passant.size() == 2 ? chess::Square(tokens.en_passant) : chess::Square(chess::Square::underlying::NO_SQ);
+    // The position carries no move counters, setFen defaults them the same way
+    hfm_ = 0;
+    plies_ = white_to_move ? 0 : 1;
+    key_ = zobrist();
+}
@@ -0,0 +1,18 @@
+#ifndef FEN_BOARD_H
+#define FEN_BOARD_H 1
+
+#include "config.h"
+#include "fen_tokens.h"
+#include "external/chess.hpp"
+
+namespace Tuner
+{
+    // Board filled straight from the fields of a tokenized line. chess::Board::setFen splits the FEN into a vector
+    // and copies it, this allocates nothing, so a board reused by a load thread costs no allocation per position.
+    class FenBoard : public chess::Board {
+    public:
+        void set_tokens(const FenTokens& tokens);
+    };
+}
+
+#endif // !FEN_BOARD_H
@@ -0,0 +1,119 @@
+#include "fen_tokens.h"
+
+#include <array>
+#include <charconv>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+struct WdlMarker
+{
+    string_view marker;
+    tune_t wdl;
+};
+
+static constexpr array<WdlMarker, 4> markers
+{
+    WdlMarker{"1.0", 1},
+
+    WdlMarker{"1-0", 1},
+    WdlMarker{"1/2-1/2", 0.5},
+    WdlMarker{"0-1", 0}
+};
+
+static bool is_word_start(const string_view text, const size_t offset)
+{
+    return offset == 0 || text[offset - 1] == ' ' || text[offset - 1] == '\t';
+}
+
+FenTokens tokenize_fen(const string_view line)
+{
+    FenTokens tokens{};
+
+    // The first four space separated fields are the position, a ';' ends it early
+    array<string_view*, 4> fields = {&tokens.board, &tokens.side_to_move, &tokens.castling, &tokens.en_passant};
+    size_t field_start = 0;
+    size_t position_end = 0;
+    for (auto field : fields)
+    {
+        if (field_start >= line.size())
+        {
+            break;
+        }
+
+        auto field_end = line.find_first_of(" ;", field_start);
+        field_end = field_end == string_view::npos ? line.size() : field_end;
+        *field = line.substr(field_start, field_end - field_start);
+        position_end = field_end;
+        if (field_end == line.size() || line[field_end] == ';')
+        {
+            break;
+        }
+        field_start = field_end + 1;
+    }
+    tokens.position = line.substr(0, position_end);
+    tokens.white_to_move = tokens.side_to_move == "w";
+
+    // Everything after the position is searched once for a result marker, a probability is only used when there is none
+    const auto rest = line.substr(position_end);
+    const WdlMarker* found_marker = nullptr;
+    string_view probability;
+    for (size_t offset = 0; offset < rest.size(); offset++)
+    {
+        const auto ch = rest[offset];
+        if (ch != '0' && ch != '1')
+        {
+            continue;
+        }
+
+        const auto candidate = rest.substr(offset);
+        const WdlMarker* marker = nullptr;
+        for (const auto& wdl_marker : markers)
+        {
+            if (candidate.starts_with(wdl_marker.marker))
+            {
+                marker = &wdl_marker;
+                break;
+            }
+        }
+
+        if (marker != nullptr)
+        {
+            if (found_marker != nullptr && found_marker != marker)
+            {
+                cout << "WDL marker already found on line " << line << endl;
+                throw runtime_error("WDL marker already found");
+            }
+            found_marker = marker;
+            tokens.result = candidate.substr(0, marker->marker.size());
+            offset += marker->marker.size() - 1;
+        }
+        else if (candidate.starts_with("0.") && (is_word_start(rest, offset) || (rest[offset - 1] == '[' && is_word_start(rest, offset - 1))))
+        {
+            const auto end = candidate.find_first_not_of("0123456789.");
+            probability = candidate.substr(0, end);
+            offset += probability.size() - 1;
+        }
+    }
+
+    if (found_marker != nullptr)
+    {
+        tokens.wdl = found_marker->wdl;
+    }
+    else if (!probability.empty())
+    {
+        double wdl = 0;
+        from_chars(probability.data(), probability.data() + probability.size(), wdl);
+        tokens.wdl = static_cast<tune_t>(wdl);
+        tokens.result = probability;
+    }
+    else
+    {
+        cout << "WDL marker not found on line " << line << endl;
+        throw runtime_error("WDL marker not found");
+    }
+
+    return tokens;
+}
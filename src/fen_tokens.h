@@ -0,0 +1,27 @@
+#ifndef FEN_TOKENS_H
+#define FEN_TOKENS_H 1
+
+#include "config.h"
+
+#include <string_view>
+
+// Fields of a data source line, all views point into the line
+struct FenTokens
+{
+    // The board, side to move, castling and en passant fields together, what chess::Board and the eval are given
+    std::string_view position;
+    std::string_view board;
+    std::string_view side_to_move;
+    std::string_view castling;
+    std::string_view en_passant;
+    // The result marker or probability as written on the line
+    std::string_view result;
+    // White relative, or side to move relative for sources with side_to_move_wdl set
+    tune_t wdl;
+    bool white_to_move;
+};
+
+// Splits a line in a single pass without allocating, throws if the line has no result or conflicting result markers
+FenTokens tokenize_fen(std::string_view line);
+
+#endif // !FEN_TOKENS_H
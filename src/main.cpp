@@ -11,11 +11,24 @@ using namespace Tuner;
 
 int main(int argc, char** argv) {
     vector<DataSource> sources;
+    RunOptions options;
     {
         string csv_path = "sources.csv";
-        if (argc > 1)
+        for (int arg_index = 1; arg_index < argc; arg_index++)
         {
-            csv_path = argv[1];
+            const string arg = argv[arg_index];
+            if (arg == "--exact-sigmoid")
+            {
+                options.exact_sigmoid = true;
+            }
+            else if (arg == "--float-kernels")
+            {
+                options.float_kernels = true;
+            }
+            else
+            {
+                csv_path = arg;
+            }
         }
         ifstream csv(csv_path);
         if(!csv)
@@ -73,6 +86,32 @@ int main(int argc, char** argv) {
                 return -1;
             }
 
+            string format_str;
+            if (getline(ss, format_str, ','))
+            {
+                if (format_str == "epd")
+                {
+                    source.format = DataFormat::Epd;
+                }
+                else if (format_str == "pgn")
+                {
+                    source.format = DataFormat::Pgn;
+                }
+                else if (format_str == "marlin")
+                {
+                    source.format = DataFormat::Marlin;
+                }
+                else if (format_str == "bullet")
+                {
+                    source.format = DataFormat::Bullet;
+                }
+                else
+                {
+                    cout << format_str << " is not a valid data source format";
+                    return -1;
+                }
+            }
+
             sources.push_back(source);
         }
     }
@@ -83,7 +122,7 @@ int main(int argc, char** argv) {
         return -1;
     }
 
-    run(sources);
+    run(sources, options);
 
     return 0;
 }
\ No newline at end of file
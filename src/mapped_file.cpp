@@ -0,0 +1,180 @@
+#include "mapped_file.h"
+
+#include <cstring>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const string& path)
+{
+    close();
+
+#if defined(_WIN32)
+    const HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size))
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    file_handle = file;
+    mapped_size = static_cast<size_t>(file_size.QuadPart);
+    opened = true;
+    if (mapped_size == 0)
+    {
+        return true;
+    }
+
+    mapping_handle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_handle == nullptr)
+    {
+        close();
+        return false;
+    }
+
+    mapped_data = static_cast<const char*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+    if (mapped_data == nullptr)
+    {
+        close();
+        return false;
+    }
+#else
+    const int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0)
+    {
+        return false;
+    }
+
+    struct stat file_stat;
+    if (fstat(file, &file_stat) != 0)
+    {
+        ::close(file);
+        return false;
+    }
+
+    mapped_size = static_cast<size_t>(file_stat.st_size);
+    opened = true;
+    if (mapped_size == 0)
+    {
+        ::close(file);
+        return true;
+    }
+
+    void* mapping = mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE, file, 0);
+    ::close(file);
+    if (mapping == MAP_FAILED)
+    {
+        mapped_size = 0;
+        opened = false;
+        return false;
+    }
+
+    madvise(mapping, mapped_size, MADV_SEQUENTIAL);
+    mapped_data = static_cast<const char*>(mapping);
+#endif
+
+    return true;
+}
+
+void MappedFile::close()
+{
+#if defined(_WIN32)
+    if (mapped_data != nullptr)
+    {
+        UnmapViewOfFile(mapped_data);
+    }
+    if (mapping_handle != nullptr)
+    {
+        CloseHandle(mapping_handle);
+        mapping_handle = nullptr;
+    }
+    if (file_handle != nullptr)
+    {
+        CloseHandle(file_handle);
+        file_handle = nullptr;
+    }
+#else
+    if (mapped_data != nullptr)
+    {
+        munmap(const_cast<char*>(mapped_data), mapped_size);
+    }
+#endif
+
+    mapped_data = nullptr;
+    mapped_size = 0;
+    opened = false;
+}
+
+bool MappedFile::is_open() const
+{
+    return opened;
+}
+
+const char* MappedFile::data() const
+{
+    return mapped_data;
+}
+
+size_t MappedFile::size() const
+{
+    return mapped_size;
+}
+
+static uint64_t hash_mix(uint64_t value)
+{
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDull;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ull;
+    value ^= value >> 33;
+    return value;
+}
+
+uint64_t hash_bytes(const void* data, const size_t size, const uint64_t seed)
+{
+    constexpr uint64_t multiplier = 0x9E3779B97F4A7C15ull;
+    const auto bytes = static_cast<const char*>(data);
+
+    // Four independent lanes so the multiply chains overlap, otherwise hashing large sources is latency bound
+    uint64_t lanes[4] = {seed, seed + multiplier, seed ^ size, ~seed};
+    size_t offset = 0;
+    for (; offset + 32 <= size; offset += 32)
+    {
+        for (int lane = 0; lane < 4; lane++)
+        {
+            uint64_t word;
+            memcpy(&word, bytes + offset + lane * 8, sizeof(word));
+            lanes[lane] = (lanes[lane] ^ word) * multiplier;
+            lanes[lane] ^= lanes[lane] >> 29;
+        }
+    }
+
+    uint64_t hash = hash_mix(lanes[0]) ^ hash_mix(lanes[1] + 1) ^ hash_mix(lanes[2] + 2) ^ hash_mix(lanes[3] + 3);
+    for (; offset < size; offset++)
+    {
+        hash = (hash ^ static_cast<uint8_t>(bytes[offset])) * multiplier;
+    }
+
+    return hash_mix(hash ^ size);
+}
@@ -0,0 +1,34 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H 1
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    bool open(const std::string& path);
+    void close();
+    bool is_open() const;
+    const char* data() const;
+    size_t size() const;
+
+private:
+    const char* mapped_data = nullptr;
+    size_t mapped_size = 0;
+    bool opened = false;
+#if defined(_WIN32)
+    void* file_handle = nullptr;
+    void* mapping_handle = nullptr;
+#endif
+};
+
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0);
+
+#endif // !MAPPED_FILE_H
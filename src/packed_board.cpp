@@ -0,0 +1,107 @@
+#include "packed_board.h"
+
+#include <algorithm>
+#include <bit>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+using namespace Tuner;
+
+constexpr uint8_t unmoved_rook = 6;
+constexpr uint8_t no_ep_square = 64;
+
+static void unpack_nibbles(const uint8_t* packed, uint8_t* nibbles)
+{
+#if defined(__SSE2__)
+    // Splits the 16 bytes into low and high nibbles and interleaves them back, 32 pieces in four instructions
+    const auto mask = _mm_set1_epi8(0x0F);
+    const auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(packed));
+    const auto low = _mm_and_si128(bytes, mask);
+    const auto high = _mm_and_si128(_mm_srli_epi16(bytes, 4), mask);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(nibbles), _mm_unpacklo_epi8(low, high));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(nibbles + 16), _mm_unpackhi_epi8(low, high));
+#else
+    for (int index = 0; index < 16; index++)
+    {
+        nibbles[index * 2] = packed[index] & 0x0F;
+        nibbles[index * 2 + 1] = packed[index] >> 4;
+    }
+#endif
+}
+
+void PackedBoard::set_pieces(uint64_t occupancy, const uint8_t* packed_pieces)
+{
+    alignas(16) uint8_t nibbles[32];
+    unpack_nibbles(packed_pieces, nibbles);
+
+    occ_bb_.fill(0ULL);
+    pieces_bb_.fill(0ULL);
+    board_.fill(chess::Piece::NONE);
+    cr_.clear();
+    prev_states_.clear();
+
+    uint64_t unmoved_rooks = 0;
+    for (int piece_index = 0; occupancy != 0 && piece_index < 32; piece_index++)
+    {
+        const auto square = countr_zero(occupancy);
+        occupancy &= occupancy - 1;
+
+        const auto nibble = nibbles[piece_index];
+        const auto color = chess::Color(static_cast<int>(nibble >> 3));
+        auto type = nibble & 7;
+        if (type == unmoved_rook)
+        {
+            unmoved_rooks |= 1ULL << square;
+            type = static_cast<int>(chess::PieceType::ROOK);
+        }
+
+        const auto piece = chess::Piece(chess::PieceType(static_cast<chess::PieceType::underlying>(type)), color);
+        pieces_bb_[piece.type()].set(square);
+        occ_bb_[color].set(square);
+        board_[square] = piece;
+    }
+
+    // Castling rights are implied by unmoved rooks, on the king's side by file
+    while (unmoved_rooks != 0)
+    {
+        const auto square = chess::Square(countr_zero(unmoved_rooks));
+        unmoved_rooks &= unmoved_rooks - 1;
+
+        const auto color = board_[square.index()].color();
+        const auto side = square.file() > kingSq(color).file() ? CastlingRights::Side::KING_SIDE : CastlingRights::Side::QUEEN_SIDE;
+        cr_.setCastlingRight(color, side, square.file());
+    }
+}
+
+tune_t PackedBoard::set_record(const MarlinRecord& record)
+{
+    set_pieces(record.occupancy, record.pieces);
+
+    const bool black_to_move = (record.stm_ep_square & 0x80) != 0;
+    const auto ep_square = record.stm_ep_square & 0x7F;
+    stm_ = black_to_move ? chess::Color::BLACK : chess::Color::WHITE;
+    ep_sq_ = ep_square == no_ep_square ? chess::Square(chess::Square::underlying::NO_SQ) : chess::Square(ep_square);
+    hfm_ = record.halfmove_clock;
+    plies_ = static_cast<uint16_t>(max(record.fullmove_number, static_cast<uint16_t>(1)) * 2 - 2 + black_to_move);
+    key_ = zobrist();
+
+    // 0 = black win, 1 = draw, 2 = white win
+    return static_cast<tune_t>(record.wdl) / 2;
+}
+
+tune_t PackedBoard::set_record(const BulletRecord& record)
+{
+    set_pieces(record.occupancy, record.pieces);
+
+    stm_ = chess::Color::WHITE;
+    ep_sq_ = chess::Square::underlying::NO_SQ;
+    hfm_ = 0;
+    plies_ = 0;
+    key_ = zobrist();
+
+    // The side to move is always white here, so the side to move relative result is also white relative
+    return static_cast<tune_t>(record.result) / 2;
+}
@@ -0,0 +1,49 @@
+#ifndef PACKED_BOARD_H
+#define PACKED_BOARD_H 1
+
+#include "config.h"
+#include "external/chess.hpp"
+
+#include <cstdint>
+
+namespace Tuner
+{
+    // marlinformat record: pieces are nibbles in occupancy order, type | black << 3 with 6 as an unmoved (castling) rook
+    struct MarlinRecord
+    {
+        uint64_t occupancy;
+        uint8_t pieces[16];
+        uint8_t stm_ep_square;
+        uint8_t halfmove_clock;
+        uint16_t fullmove_number;
+        int16_t eval;
+        uint8_t wdl;
+        uint8_t extra;
+    };
+    static_assert(sizeof(MarlinRecord) == 32);
+
+    // bulletformat record: the board is stored from the side to move's point of view, as is the result
+    struct BulletRecord
+    {
+        uint64_t occupancy;
+        uint8_t pieces[16];
+        int16_t score;
+        uint8_t result;
+        uint8_t king_square;
+        uint8_t opponent_king_square;
+        uint8_t extra[3];
+    };
+    static_assert(sizeof(BulletRecord) == 32);
+
+    // Board filled straight from a packed record, no FEN is produced on the way
+    class PackedBoard : public chess::Board {
+    public:
+        tune_t set_record(const MarlinRecord& record);
+        tune_t set_record(const BulletRecord& record);
+
+    private:
+        void set_pieces(uint64_t occupancy, const uint8_t* packed_pieces);
+    };
+}
+
+#endif // !PACKED_BOARD_H
@@ -0,0 +1,42 @@
+#include "sigmoid.h"
+
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+
+template<typename Scalar>
+void check_fast_sigmoid()
+{
+    // Past |x| = 50 both sigmoids are within 2e-22 of 0 or 1
+    constexpr int32_t sample_count = 2000001;
+    constexpr long double max_argument = 50;
+
+    long double max_error = 0;
+    long double max_error_argument = 0;
+    for (int32_t sample = 0; sample < sample_count; sample++)
+    {
+        const auto argument = static_cast<Scalar>(-max_argument + 2 * max_argument * sample / (sample_count - 1));
+        // K = 400 makes the argument of the exponential -eval
+        const auto fast = static_cast<long double>(fast_sigmoid(static_cast<Scalar>(400), argument));
+        const auto exact = 1.0L / (1.0L + expl(-static_cast<long double>(argument)));
+        const auto error = fabsl(fast - exact);
+        if (error > max_error)
+        {
+            max_error = error;
+            max_error_argument = argument;
+        }
+    }
+
+    const auto precision = is_same_v<Scalar, double> ? "double" : "float";
+    cout << "Fast " << precision << " sigmoid max error " << static_cast<double>(max_error) << " at " << static_cast<double>(max_error_argument) << ", bound " << fast_sigmoid_max_error<Scalar> << endl;
+    if (max_error > fast_sigmoid_max_error<Scalar>)
+    {
+        cout << "The fast sigmoid exceeds its error bound, run with --exact-sigmoid" << endl;
+        throw runtime_error("Fast sigmoid exceeds its error bound");
+    }
+}
+
+template void check_fast_sigmoid<double>();
+template void check_fast_sigmoid<float>();
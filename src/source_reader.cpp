@@ -0,0 +1,215 @@
+#include "source_reader.h"
+
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+
+#if defined(TUNER_ZLIB)
+#include <zlib.h>
+#endif
+
+#if defined(TUNER_ZSTD)
+#include <zstd.h>
+#endif
+
+using namespace std;
+
+constexpr size_t input_buffer_size = 1 << 20;
+
+Compression detect_compression(const string& path)
+{
+    ifstream file(path, ios::binary);
+    array<unsigned char, 4> magic{};
+    file.read(reinterpret_cast<char*>(magic.data()), magic.size());
+    const auto magic_size = file.gcount();
+
+    if (magic_size >= 2 && magic[0] == 0x1F && magic[1] == 0x8B)
+    {
+        return Compression::Gzip;
+    }
+
+    if (magic_size >= 4 && magic[0] == 0x28 && magic[1] == 0xB5 && magic[2] == 0x2F && magic[3] == 0xFD)
+    {
+        return Compression::Zstd;
+    }
+
+    return Compression::None;
+}
+
+SourceReader::SourceReader(const string& path, const Compression compression)
+    : compression(compression), file(path, ios::binary)
+{
+    if (!file)
+    {
+        cout << "Failed to open " << path << endl;
+        throw runtime_error("Failed to open data source");
+    }
+
+    if (compression == Compression::None)
+    {
+        return;
+    }
+
+    input.resize(input_buffer_size);
+    if (compression == Compression::Gzip)
+    {
+#if defined(TUNER_ZLIB)
+        auto gzip_stream = new z_stream{};
+        // 15 window bits + 32 accepts both gzip and zlib headers
+        if (inflateInit2(gzip_stream, 15 + 32) != Z_OK)
+        {
+            delete gzip_stream;
+            throw runtime_error("Failed to initialize zlib");
+        }
+        stream = gzip_stream;
+#else
+        cout << path << " is gzip compressed, but the tuner was built without zlib" << endl;
+        throw runtime_error("gzip is not supported");
+#endif
+    }
+    else if (compression == Compression::Zstd)
+    {
+#if defined(TUNER_ZSTD)
+        stream = ZSTD_createDStream();
+        if (stream == nullptr || ZSTD_isError(ZSTD_initDStream(static_cast<ZSTD_DStream*>(stream))))
+        {
+            ZSTD_freeDStream(static_cast<ZSTD_DStream*>(stream));
+            throw runtime_error("Failed to initialize zstd");
+        }
+#else
+        cout << path << " is zstd compressed, but the tuner was built without libzstd" << endl;
+        throw runtime_error("zstd is not supported");
+#endif
+    }
+}
+
+SourceReader::~SourceReader()
+{
+#if defined(TUNER_ZLIB)
+    if (compression == Compression::Gzip && stream != nullptr)
+    {
+        inflateEnd(static_cast<z_stream*>(stream));
+        delete static_cast<z_stream*>(stream);
+    }
+#endif
+#if defined(TUNER_ZSTD)
+    if (compression == Compression::Zstd && stream != nullptr)
+    {
+        ZSTD_freeDStream(static_cast<ZSTD_DStream*>(stream));
+    }
+#endif
+}
+
+size_t SourceReader::read(char* buffer, const size_t size)
+{
+    switch (compression)
+    {
+    case Compression::Gzip:
+        return read_gzip(buffer, size);
+    case Compression::Zstd:
+        return read_zstd(buffer, size);
+    case Compression::None:
+    default:
+        file.read(buffer, static_cast<streamsize>(size));
+        return static_cast<size_t>(file.gcount());
+    }
+}
+
+bool SourceReader::fill_input()
+{
+    file.read(input.data(), static_cast<streamsize>(input.size()));
+    input_offset = 0;
+    input_size = static_cast<size_t>(file.gcount());
+    return input_size > 0;
+}
+
+size_t SourceReader::read_gzip([[maybe_unused]] char* buffer, [[maybe_unused]] const size_t size)
+{
+#if defined(TUNER_ZLIB)
+    const auto gzip_stream = static_cast<z_stream*>(stream);
+    gzip_stream->next_out = reinterpret_cast<Bytef*>(buffer);
+    gzip_stream->avail_out = static_cast<uInt>(size);
+
+    while (gzip_stream->avail_out == size)
+    {
+        if (stream_finished)
+        {
+            // Concatenated gzip members, as written by pigz or by appending compressed files
+            if (input_offset == input_size && !fill_input())
+            {
+                break;
+            }
+            inflateReset(gzip_stream);
+            stream_finished = false;
+        }
+
+        gzip_stream->next_in = reinterpret_cast<Bytef*>(input.data() + input_offset);
+        gzip_stream->avail_in = static_cast<uInt>(input_size - input_offset);
+        const auto result = inflate(gzip_stream, Z_NO_FLUSH);
+        input_offset = input_size - gzip_stream->avail_in;
+
+        if (result == Z_STREAM_END)
+        {
+            stream_finished = true;
+            continue;
+        }
+
+        if (result != Z_OK && result != Z_BUF_ERROR)
+        {
+            throw runtime_error("Corrupt gzip data source");
+        }
+
+        if (gzip_stream->avail_out == size && input_offset == input_size && !fill_input())
+        {
+            throw runtime_error("Truncated gzip data source");
+        }
+    }
+
+    return size - gzip_stream->avail_out;
+#else
+    return 0;
+#endif
+}
+
+size_t SourceReader::read_zstd([[maybe_unused]] char* buffer, [[maybe_unused]] const size_t size)
+{
+#if defined(TUNER_ZSTD)
+    const auto zstd_stream = static_cast<ZSTD_DStream*>(stream);
+    ZSTD_outBuffer output{buffer, size, 0};
+
+    while (output.pos == 0)
+    {
+        // Decompress before refilling, the stream may still hold output from input it already consumed
+        ZSTD_inBuffer stream_input{input.data() + input_offset, input_size - input_offset, 0};
+        const auto result = ZSTD_decompressStream(zstd_stream, &output, &stream_input);
+        input_offset += stream_input.pos;
+
+        if (ZSTD_isError(result))
+        {
+            cout << "zstd error: " << ZSTD_getErrorName(result) << endl;
+            throw runtime_error("Corrupt zstd data source");
+        }
+
+        // 0 means a frame was completed and fully flushed, another frame may follow.
+        // A call without any input or output made no progress and says nothing about the frame.
+        if (stream_input.pos > 0 || output.pos > 0)
+        {
+            stream_finished = result == 0;
+        }
+
+        if (output.pos == 0 && input_offset == input_size && !fill_input())
+        {
+            if (!stream_finished)
+            {
+                throw runtime_error("Truncated zstd data source");
+            }
+            break;
+        }
+    }
+
+    return output.pos;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,44 @@
+#ifndef SOURCE_READER_H
+#define SOURCE_READER_H 1
+
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <vector>
+
+enum class Compression
+{
+    None,
+    Gzip,
+    Zstd
+};
+
+// Detects gzip and zstd sources by their magic bytes
+Compression detect_compression(const std::string& path);
+
+// Sequential reader over a data source, decompressing gzip and zstd sources on the fly
+class SourceReader {
+public:
+    SourceReader(const std::string& path, Compression compression);
+    SourceReader(const SourceReader&) = delete;
+    SourceReader& operator=(const SourceReader&) = delete;
+    ~SourceReader();
+
+    // Returns the number of bytes written to buffer, 0 once the source is exhausted
+    size_t read(char* buffer, size_t size);
+
+private:
+    Compression compression;
+    std::ifstream file;
+    std::vector<char> input;
+    size_t input_offset = 0;
+    size_t input_size = 0;
+    bool stream_finished = false;
+    void* stream = nullptr;
+
+    bool fill_input();
+    size_t read_gzip(char* buffer, size_t size);
+    size_t read_zstd(char* buffer, size_t size);
+};
+
+#endif // !SOURCE_READER_H
@@ -1,19 +1,43 @@
 #include "threadpool.h"
+#include "topology.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <thread>
 
 using namespace std;
 
-void ThreadPool::start(uint32_t thread_count)
+void ThreadPool::start(uint32_t thread_count, bool pin_threads)
 {
     stop();
     should_stop = false;
-    for (int thread_index = 0; thread_index < thread_count; thread_index++)
+
+    const auto node_processors = get_node_processors();
+    nodes = pin_threads ? max(min(static_cast<uint32_t>(node_processors.size()), thread_count), 1u) : 1;
+    thread_nodes.assign(thread_count, 0);
+    thread_jobs.assign(thread_count, {});
+    queued_thread_job_count = 0;
+
+    uint32_t first_node_thread = 0;
+    for (uint32_t thread_index = 0; thread_index < thread_count; thread_index++)
     {
-        threads.emplace_back([this]()
+        const auto node = static_cast<uint32_t>(static_cast<uint64_t>(thread_index) * nodes / thread_count);
+        if (thread_index == 0 || node != thread_nodes[thread_index - 1])
         {
-            thread_loop();
+            first_node_thread = thread_index;
+        }
+        thread_nodes[thread_index] = node;
+
+        // Threads beyond the processors of their node share them round robin
+        const auto& processors = node_processors[node];
+        const auto processor = processors[(thread_index - first_node_thread) % processors.size()];
+        threads.emplace_back([this, thread_index, pin_threads, processor]()
+        {
+            if (pin_threads)
+            {
+                pin_thread_to_processor(processor);
+            }
+            thread_loop(thread_index);
         });
     }
 }
@@ -23,6 +47,16 @@ uint32_t ThreadPool::thread_count() const
     return static_cast<uint32_t>(threads.size());
 }
 
+uint32_t ThreadPool::node_count() const
+{
+    return nodes;
+}
+
+uint32_t ThreadPool::get_thread_node(const uint32_t thread_index) const
+{
+    return thread_nodes[thread_index];
+}
+
 void ThreadPool::enqueue(const function<void()>& job)
 {
     {
@@ -32,6 +66,18 @@ void ThreadPool::enqueue(const function<void()>& job)
     mutex_condition.notify_one();
 }
 
+void ThreadPool::enqueue(const uint32_t thread_index, const function<void()>& job)
+{
+    {
+        unique_lock<mutex> lock(queue_mutex);
+        thread_jobs[thread_index].push(job);
+        queued_thread_job_count++;
+    }
+
+    // The condition is shared by all threads, only waking all of them is sure to reach the right one
+    mutex_condition.notify_all();
+}
+
 void ThreadPool::stop()
 {
     {
@@ -51,31 +97,32 @@ void ThreadPool::stop()
 bool ThreadPool::is_idle()
 {
     unique_lock<mutex> lock(queue_mutex);
-    return jobs.empty() && running_job_count == 0;
+    return jobs.empty() && queued_thread_job_count == 0 && running_job_count == 0;
 }
 
 void ThreadPool::wait_for_completion()
 {
     unique_lock<mutex> lock(queue_mutex);
-    while(!jobs.empty() || running_job_count > 0)
+    while(!jobs.empty() || queued_thread_job_count > 0 || running_job_count > 0)
     {
         completion_condition.wait(lock, [this]
         {
-            return jobs.empty() && running_job_count == 0;
+            return jobs.empty() && queued_thread_job_count == 0 && running_job_count == 0;
         });
     }
 }
 
-void ThreadPool::thread_loop()
+void ThreadPool::thread_loop(const uint32_t thread_index)
 {
     while (true)
     {
         function<void()> job;
         {
             unique_lock<mutex> lock(queue_mutex);
-            mutex_condition.wait(lock, [this]
+            auto& own_jobs = thread_jobs[thread_index];
+            mutex_condition.wait(lock, [this, &own_jobs]
             {
-                return !jobs.empty() || should_stop;
+                return !own_jobs.empty() || !jobs.empty() || should_stop;
             });
 
             if (should_stop)
@@ -83,8 +130,17 @@ void ThreadPool::thread_loop()
                 return;
             }
 
-            job = jobs.front();
-            jobs.pop();
+            if (!own_jobs.empty())
+            {
+                job = own_jobs.front();
+                own_jobs.pop();
+                queued_thread_job_count--;
+            }
+            else
+            {
+                job = jobs.front();
+                jobs.pop();
+            }
             running_job_count++;
         }
 
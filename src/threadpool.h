@@ -6,12 +6,20 @@
 #include <mutex>
 #include <queue>
 #include <thread>
+#include <vector>
 
 class ThreadPool {
 public:
-    void start(uint32_t thread_count);
+    // With pin_threads each thread is bound to one processor. Threads are spread evenly over the NUMA nodes
+    // in index order, so consecutive thread indices share a node.
+    void start(uint32_t thread_count, bool pin_threads = false);
     uint32_t thread_count() const;
+    uint32_t node_count() const;
+    // NUMA node the thread runs on, 0 for all threads when they are not pinned
+    uint32_t get_thread_node(uint32_t thread_index) const;
     void enqueue(const std::function<void()>& job);
+    // Runs job on the given thread, so it finds the memory that thread placed on its node
+    void enqueue(uint32_t thread_index, const std::function<void()>& job);
     void stop();
     bool is_idle();
     void wait_for_completion();
@@ -23,9 +31,13 @@ private:
     std::condition_variable mutex_condition;
     std::condition_variable completion_condition;
     std::vector<std::thread> threads;
+    std::vector<uint32_t> thread_nodes;
+    uint32_t nodes = 1;
     std::queue<std::function<void()>> jobs;
+    std::vector<std::queue<std::function<void()>>> thread_jobs;
+    uint32_t queued_thread_job_count = 0;
 
-    void thread_loop();
+    void thread_loop(uint32_t thread_index);
 };
 
 #endif // !THREADPOOL_H
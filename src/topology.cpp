@@ -0,0 +1,134 @@
+#include "topology.h"
+
+#include <algorithm>
+#include <string>
+#include <thread>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined(__linux__)
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+
+#if defined(__linux__)
+// Parses a sysfs id list such as "0-5,12-17"
+static vector<uint32_t> parse_id_list(const string& list)
+{
+    vector<uint32_t> ids;
+    size_t position = 0;
+    while (position < list.size())
+    {
+        auto range_end = list.find(',', position);
+        if (range_end == string::npos)
+        {
+            range_end = list.size();
+        }
+
+        const auto range = list.substr(position, range_end - position);
+        const auto dash = range.find('-');
+        const auto first = static_cast<uint32_t>(stoul(range.substr(0, dash)));
+        const auto last = dash == string::npos ? first : static_cast<uint32_t>(stoul(range.substr(dash + 1)));
+        for (auto id = first; id <= last; id++)
+        {
+            ids.push_back(id);
+        }
+        position = range_end + 1;
+    }
+    return ids;
+}
+#endif
+
+vector<vector<uint32_t>> get_node_processors()
+{
+    vector<vector<uint32_t>> nodes;
+
+#if defined(__linux__)
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    const bool has_affinity = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+    const auto is_allowed = [&](const uint32_t processor)
+    {
+        return !has_affinity || (processor < CPU_SETSIZE && CPU_ISSET(processor, &allowed));
+    };
+
+    ifstream online_file("/sys/devices/system/node/online");
+    string online;
+    if (online_file && getline(online_file, online))
+    {
+        for (const auto node : parse_id_list(online))
+        {
+            ifstream file("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+            string list;
+            if (!file || !getline(file, list))
+            {
+                continue;
+            }
+
+            vector<uint32_t> processors;
+            for (const auto processor : parse_id_list(list))
+            {
+                if (is_allowed(processor))
+                {
+                    processors.push_back(processor);
+                }
+            }
+            if (!processors.empty())
+            {
+                nodes.push_back(std::move(processors));
+            }
+        }
+    }
+
+    if (nodes.empty() && has_affinity)
+    {
+        nodes.emplace_back();
+        for (uint32_t processor = 0; processor < CPU_SETSIZE; processor++)
+        {
+            if (CPU_ISSET(processor, &allowed))
+            {
+                nodes.back().push_back(processor);
+            }
+        }
+    }
+#endif
+
+    if (nodes.empty())
+    {
+        nodes.emplace_back();
+        const auto processor_count = max(thread::hardware_concurrency(), 1u);
+        for (uint32_t processor = 0; processor < processor_count; processor++)
+        {
+            nodes.back().push_back(processor);
+        }
+    }
+
+    return nodes;
+}
+
+bool pin_thread_to_processor(const uint32_t processor)
+{
+#if defined(_WIN32)
+    if (processor >= 64)
+    {
+        return false;
+    }
+    return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << processor) != 0;
+#elif defined(__linux__)
+    if (processor >= CPU_SETSIZE)
+    {
+        return false;
+    }
+    cpu_set_t processors;
+    CPU_ZERO(&processors);
+    CPU_SET(processor, &processors);
+    return pthread_setaffinity_np(pthread_self(), sizeof(processors), &processors) == 0;
+#else
+    return false;
+#endif
+}
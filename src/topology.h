@@ -0,0 +1,14 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H 1
+
+#include <cstdint>
+#include <vector>
+
+// Processors the process is allowed to run on, grouped by NUMA node.
+// Platforms without NUMA information report all processors as a single node.
+std::vector<std::vector<uint32_t>> get_node_processors();
+
+// Binds the calling thread to a single processor, false if that is not supported or failed
+bool pin_thread_to_processor(uint32_t processor);
+
+#endif // !TOPOLOGY_H
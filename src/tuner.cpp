@@ -1,16 +1,45 @@
 #include "tuner.h"
 #include "config.h"
+#include "entry.h"
+#include "allocation_counter.h"
+#include "arena.h"
+#include "bounded_queue.h"
+#include "deduplication.h"
+#include "entry_cache.h"
+#include "entry_shards.h"
+#include "fen_board.h"
+#include "fen_tokens.h"
+#include "mapped_file.h"
+#include "packed_board.h"
+#include "sigmoid.h"
+#include "source_reader.h"
 #include "threadpool.h"
+#include "vector_kernels.h"
 #include "external/chess.hpp"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <bit>
 #include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
 #include <fstream>
+#include <functional>
 #include <iostream>
-#include <sstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
 #include <stdexcept>
+#include <streambuf>
+#include <string_view>
 #include <thread>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 using namespace std;
@@ -21,97 +50,6 @@ using namespace Tuner;
 static_assert(false, "Tuner requires TAPERED to be defined")
 #endif
 
-struct WdlMarker
-{
-    string marker;
-    tune_t wdl;
-};
-
-struct CoefficientEntry
-{
-    int16_t value;
-    int16_t index;
-};
-
-struct Entry
-{
-    vector<CoefficientEntry> coefficients;
-    tune_t wdl;
-    bool white_to_move;
-    //tune_t initial_eval;
-    tune_t additional_score;
-#if TAPERED
-    int32_t phase;
-    tune_t endgame_scale;
-#endif
-};
-
-static const array<WdlMarker, 4> markers
-{
-    WdlMarker{"1.0", 1},
-
-    WdlMarker{"1-0", 1},
-    WdlMarker{"1/2-1/2", 0.5},
-    WdlMarker{"0-1", 0}
-};
-
-static tune_t get_fen_wdl(const string& original_fen, const bool original_white_to_move, const bool white_to_move, const bool side_to_move_wdl)
-{
-    tune_t wdl;
-    bool marker_found = false;
-    for (auto& marker : markers)
-    {
-        if (original_fen.find(marker.marker) != std::string::npos)
-        {
-            if (marker_found)
-            {
-                cout << "WDL marker already found on line " << original_fen << endl;
-                throw std::runtime_error("WDL marker already found");
-            }
-            marker_found = true;
-            wdl = marker.wdl;
-        }
-    }
-
-    if(!marker_found)
-    {
-        stringstream ss(original_fen);
-        while (!ss.eof())
-        {
-            string word;
-            ss >> word;
-            if (word.starts_with("0."))
-            {
-                wdl = stod(word);
-                marker_found = true;
-            }
-            else if (word.starts_with("[0."))
-            {
-                wdl = stod(word.substr(1, word.size() - 2));
-                marker_found = true;
-            }
-        }
-    }
-
-    if (!marker_found)
-    {
-        cout << "WDL marker not found on line " << original_fen << endl;
-        throw std::runtime_error("WDL marker not found");
-    }
-
-    if(!original_white_to_move && side_to_move_wdl)
-    {
-        wdl = 1 - wdl;
-    }
-
-    return wdl;
-}   
-
-static bool get_fen_color_to_move(const string& fen)
-{
-    return fen.find('w') != std::string::npos;
-}
-
 static void print_elapsed(high_resolution_clock::time_point start)
 {
     const auto now = high_resolution_clock::now();
@@ -120,14 +58,19 @@ static void print_elapsed(high_resolution_clock::time_point start)
     cout << "[" << elapsed_seconds << "s] ";
 }
 
-static void get_coefficient_entries(const coefficients_t& coefficients, vector<CoefficientEntry>& coefficient_entries, int32_t parameter_count)
+template<typename Allocator>
+static void get_coefficient_entries(const coefficients_t& coefficients, vector<CoefficientEntry, Allocator>& coefficient_entries, int32_t parameter_count)
 {
     if(coefficients.size() != parameter_count)
     {
         throw runtime_error("Parameter count mismatch");
     }
 
-    for (int16_t i = 0; i < coefficients.size(); i++)
+    // Sized up front, growing the vector one coefficient at a time was the largest cost of loading
+    const auto nonzero_count = count_if(coefficients.begin(), coefficients.end(), [](const auto coefficient) { return coefficient != 0; });
+    coefficient_entries.reserve(coefficient_entries.size() + nonzero_count);
+
+    for (int32_t i = 0; i < coefficients.size(); i++)
     {
         if (coefficients[i] == 0)
         {
@@ -139,20 +82,20 @@ static void get_coefficient_entries(const coefficients_t& coefficients, vector<C
     }
 }
 
-static tune_t linear_eval(const Entry& entry, const parameters_t& parameters)
+static tune_t linear_eval(const Entry& entry, const span<const CoefficientEntry> coefficients, const parameters_t& parameters)
 {
     tune_t score = entry.additional_score;
 #if TAPERED 
     tune_t midgame = 0;
     tune_t endgame = 0;
-    for (const auto& coefficient : entry.coefficients)
+    for (const auto& coefficient : coefficients)
     {
         midgame += coefficient.value * parameters[coefficient.index][static_cast<int32_t>(PhaseStages::Midgame)];
-        endgame += coefficient.value * parameters[coefficient.index][static_cast<int32_t>(PhaseStages::Endgame)] * entry.endgame_scale;
+        endgame += coefficient.value * parameters[coefficient.index][static_cast<int32_t>(PhaseStages::Endgame)];
     }
-    score += (midgame * entry.phase + endgame * (24 - entry.phase)) / 24;
+    score += midgame * entry.midgame_weight + endgame * entry.endgame_weight;
 #else
-    for (const auto& coefficient : entry.coefficients)
+    for (const auto& coefficient : coefficients)
     {
         score += coefficient.value * parameters[coefficient.index];
     }
@@ -161,7 +104,68 @@ static tune_t linear_eval(const Entry& entry, const parameters_t& parameters)
     return score;
 }
 
-static int32_t get_phase(const string& fen)
+// Parameters as the epoch kernels read them, in the kernel precision
+template<typename Scalar>
+struct KernelParameters
+{
+    // Either the tuned parameters themselves or converted
+    const basic_parameters_t<Scalar>* sparse = nullptr;
+    basic_parameters_t<Scalar> converted;
+    // Parameters of the dense coefficient slots of the entries, in slot order
+    basic_parameters_t<Scalar> dense;
+    // Set for tapered double precision kernels when the processor has a vectorized instruction set
+    const VectorKernels* vector_kernels = nullptr;
+    // Evaluates the sigmoid with exp instead of fast_sigmoid
+    bool exact_sigmoid = false;
+};
+
+// Same as above for a stored entry, reading only the columns the evaluation needs
+template<typename Scalar>
+static Scalar linear_eval(const BasicEntryList<Scalar>& entries, const size_t entry_index, const KernelParameters<Scalar>& kernel_parameters)
+{
+    const auto& parameters = *kernel_parameters.sparse;
+    const auto dense_coefficients = entries.get_dense_coefficients(entry_index);
+    Scalar score = entries.get_additional_scores()[entry_index];
+#if TAPERED
+    Scalar midgame = 0;
+    Scalar endgame = 0;
+    for (size_t slot = 0; slot < dense_coefficients.size(); slot++)
+    {
+        const auto value = static_cast<Scalar>(dense_coefficients[slot]);
+        midgame += value * kernel_parameters.dense[slot][static_cast<int32_t>(PhaseStages::Midgame)];
+        endgame += value * kernel_parameters.dense[slot][static_cast<int32_t>(PhaseStages::Endgame)];
+    }
+    const auto coefficients = entries.get_encoded_coefficients(entry_index, entry_index + 1);
+    if constexpr (is_same_v<Scalar, double>)
+    {
+        if (kernel_parameters.vector_kernels != nullptr)
+        {
+            array<double, 2> sums{midgame, endgame};
+            kernel_parameters.vector_kernels->evaluate(coefficients.data(), coefficients.data() + coefficients.size(), parameters.data(), sums);
+            return score + sums[static_cast<int32_t>(PhaseStages::Midgame)] * entries.get_midgame_weights()[entry_index] + sums[static_cast<int32_t>(PhaseStages::Endgame)] * entries.get_endgame_weights()[entry_index];
+        }
+    }
+    decode_coefficients<Scalar>(coefficients.data(), coefficients.data() + coefficients.size(), [&](const size_t index, const Scalar value)
+    {
+        midgame += value * parameters[index][static_cast<int32_t>(PhaseStages::Midgame)];
+        endgame += value * parameters[index][static_cast<int32_t>(PhaseStages::Endgame)];
+    });
+    score += midgame * entries.get_midgame_weights()[entry_index] + endgame * entries.get_endgame_weights()[entry_index];
+#else
+    for (size_t slot = 0; slot < dense_coefficients.size(); slot++)
+    {
+        score += static_cast<Scalar>(dense_coefficients[slot]) * kernel_parameters.dense[slot];
+    }
+    entries.for_each_coefficient(entry_index, [&](const size_t index, const Scalar value)
+    {
+        score += value * parameters[index];
+    });
+#endif
+
+    return score;
+}
+
+static int32_t get_phase(const string_view fen)
 {
     int32_t phase = 0;
     auto stop = false;
@@ -239,7 +243,204 @@ static int32_t get_phase(const chess::Board& board)
     return phase;
 }
 
-static void print_statistics(const parameters_t& parameters, const vector<Entry>& entries)
+// Coefficients present in nearly every entry are cheaper as a dense dot product than decoded one by one
+static void promote_dense_coefficients(EntryList& entries, const size_t parameter_count)
+{
+    if (entries.empty())
+    {
+        return;
+    }
+
+    vector<size_t> counts(parameter_count, 0);
+    for (size_t entry_index = 0; entry_index < entries.size(); entry_index++)
+    {
+        entries.for_each_coefficient(entry_index, [&](const size_t index, tune_t) { counts[index]++; });
+    }
+
+    vector<uint32_t> dense_indices;
+    for (size_t parameter_index = 0; parameter_index < parameter_count; parameter_index++)
+    {
+        if (counts[parameter_index] >= dense_coefficient_min_frequency * entries.size())
+        {
+            dense_indices.push_back(static_cast<uint32_t>(parameter_index));
+        }
+    }
+
+    cout << dense_indices.size() << " of " << parameter_count << " parameters are in at least " << dense_coefficient_min_frequency * 100 << "% of the entries";
+    for (const auto index : dense_indices)
+    {
+        cout << (index == dense_indices.front() ? ": " : ", ") << index << " (" << counts[index] * 100.0 / entries.size() << "%)";
+    }
+    cout << endl;
+
+    if (dense_indices.size() < dense_coefficient_min_count)
+    {
+        cout << "Keeping all coefficients sparse, dense coefficients need at least " << dense_coefficient_min_count << endl << endl;
+        return;
+    }
+
+    entries.promote_dense(dense_indices);
+    cout << "Promoted them to dense coefficients" << endl << endl;
+}
+
+#if TAPERED
+// Done once while loading, so the epoch kernels never divide by the phase range again
+static void set_phase_weights(Entry& entry, const int32_t phase, const tune_t endgame_scale)
+{
+    entry.midgame_weight = phase / static_cast<tune_t>(24);
+    entry.endgame_weight = (1 - entry.midgame_weight) * endgame_scale;
+}
+#endif
+
+// Entries the co-occurrence of parameters is counted on, spread evenly over all entries
+constexpr size_t parameter_order_sample_size = 4096;
+
+// Orders the parameters so the ones the sparse coefficients use most come first and parameters that appear
+// in the same entries share cache lines of the parameter and gradient arrays.
+// Returns the original index of each parameter in the new order.
+static vector<uint32_t> get_parameter_order(const EntryList& entries, const size_t parameter_count)
+{
+    vector<size_t> counts(parameter_count, 0);
+    for (size_t entry_index = 0; entry_index < entries.size(); entry_index++)
+    {
+        entries.for_each_coefficient(entry_index, [&](const size_t index, tune_t) { counts[index]++; });
+    }
+
+    unordered_map<uint64_t, uint32_t> pair_counts;
+    vector<uint32_t> entry_indices;
+    const auto sample_interval = max<size_t>(entries.size() / parameter_order_sample_size, 1);
+    for (size_t entry_index = 0; entry_index < entries.size(); entry_index += sample_interval)
+    {
+        entry_indices.clear();
+        entries.for_each_coefficient(entry_index, [&](const size_t index, tune_t) { entry_indices.push_back(static_cast<uint32_t>(index)); });
+        for (size_t first = 0; first < entry_indices.size(); first++)
+        {
+            for (size_t second = first + 1; second < entry_indices.size(); second++)
+            {
+                pair_counts[(static_cast<uint64_t>(entry_indices[first]) << 32) | entry_indices[second]]++;
+            }
+        }
+    }
+
+    vector<vector<pair<uint32_t, uint32_t>>> neighbors(parameter_count);
+    for (const auto& [key, count] : pair_counts)
+    {
+        const auto first = static_cast<uint32_t>(key >> 32);
+        const auto second = static_cast<uint32_t>(key);
+        neighbors[first].emplace_back(second, count);
+        neighbors[second].emplace_back(first, count);
+    }
+
+    vector<uint32_t> by_count(parameter_count);
+    for (uint32_t parameter_index = 0; parameter_index < parameter_count; parameter_index++)
+    {
+        by_count[parameter_index] = parameter_index;
+    }
+    stable_sort(by_count.begin(), by_count.end(), [&counts](const uint32_t left, const uint32_t right)
+    {
+        return counts[left] > counts[right];
+    });
+
+    // Each cache line is started with the most used parameter left and filled with the parameters
+    // that appear most often together with those already in it
+    constexpr size_t parameters_per_line = max<size_t>(64 / sizeof(parameters_t::value_type), 1);
+    vector<uint32_t> order;
+    order.reserve(parameter_count);
+    vector<bool> placed(parameter_count, false);
+    vector<uint64_t> line_scores(parameter_count, 0);
+    vector<uint32_t> line_candidates;
+    size_t next_by_count = 0;
+    while (order.size() < parameter_count)
+    {
+        uint32_t next = 0;
+        bool found = false;
+        if (order.size() % parameters_per_line != 0)
+        {
+            for (const auto candidate : line_candidates)
+            {
+                if (!placed[candidate] && (!found || line_scores[candidate] > line_scores[next] || (line_scores[candidate] == line_scores[next] && counts[candidate] > counts[next])))
+                {
+                    next = candidate;
+                    found = true;
+                }
+            }
+        }
+        else
+        {
+            for (const auto candidate : line_candidates)
+            {
+                line_scores[candidate] = 0;
+            }
+            line_candidates.clear();
+        }
+
+        if (!found)
+        {
+            while (placed[by_count[next_by_count]])
+            {
+                next_by_count++;
+            }
+            next = by_count[next_by_count];
+        }
+
+        placed[next] = true;
+        order.push_back(next);
+        for (const auto& [neighbor, count] : neighbors[next])
+        {
+            if (line_scores[neighbor] == 0)
+            {
+                line_candidates.push_back(neighbor);
+            }
+            line_scores[neighbor] += count;
+        }
+    }
+
+    return order;
+}
+
+// Renumbers the parameters by get_parameter_order, the entries and parameters are changed in place.
+// Returns the original index of each parameter, to print them in the order of the evaluation.
+static vector<uint32_t> reorder_parameters(EntryList& entries, parameters_t& parameters)
+{
+    const auto order = get_parameter_order(entries, parameters.size());
+    vector<uint32_t> new_indices(parameters.size());
+    parameters_t reordered(parameters.size());
+    for (size_t new_index = 0; new_index < order.size(); new_index++)
+    {
+        new_indices[order[new_index]] = static_cast<uint32_t>(new_index);
+        reordered[new_index] = parameters[order[new_index]];
+    }
+
+    entries.renumber_parameters(new_indices);
+    parameters = std::move(reordered);
+
+    size_t moved_count = 0;
+    for (size_t new_index = 0; new_index < order.size(); new_index++)
+    {
+        moved_count += order[new_index] != new_index;
+    }
+    cout << "Reordered " << moved_count << " of " << parameters.size() << " parameters by coefficient frequency and co-occurrence" << endl << endl;
+    return order;
+}
+
+// Prints the parameters in the order of the evaluation, original_indices is empty when they were never reordered
+static void print_parameters(const parameters_t& parameters, const vector<uint32_t>& original_indices)
+{
+    if (original_indices.empty())
+    {
+        TuneEval::print_parameters(parameters);
+        return;
+    }
+
+    parameters_t original(parameters.size());
+    for (size_t parameter_index = 0; parameter_index < parameters.size(); parameter_index++)
+    {
+        original[original_indices[parameter_index]] = parameters[parameter_index];
+    }
+    TuneEval::print_parameters(original);
+}
+
+static void print_statistics(const parameters_t& parameters, const EntryList& entries)
 {
     array<size_t, 2> wins{};
     array<size_t, 2> draws{};
@@ -251,34 +452,40 @@ static void print_statistics(const parameters_t& parameters, const vector<Entry>
     size_t max_parameters = 0;
     size_t total_parameters = 0;
 
-    for(auto& entry : entries)
+    const auto entry_wdls = entries.get_wdls();
+    const auto white_to_moves = entries.get_white_to_moves();
+    for (size_t entry_index = 0; entry_index < entries.size(); entry_index++)
     {
-        if(entry.wdl == 1)
+        const auto wdl = entry_wdls[entry_index];
+        const auto white_to_move = white_to_moves[entry_index];
+        size_t coefficient_count = 0;
+        entries.for_each_coefficient(entry_index, [&](size_t, tune_t) { coefficient_count++; });
+        if(wdl == 1)
         {
-            wins[entry.white_to_move]++;
+            wins[white_to_move]++;
         }
-        else if(entry.wdl == 0.5)
+        else if(wdl == 0.5)
         {
-            draws[entry.white_to_move]++;
+            draws[white_to_move]++;
         }
-        else if (entry.wdl == 0.0)
+        else if (wdl == 0.0)
         {
-            losses[entry.white_to_move]++;
+            losses[white_to_move]++;
         }
-        total[entry.white_to_move]++;
-        wdls[entry.white_to_move] += entry.wdl;
+        total[white_to_move]++;
+        wdls[white_to_move] += wdl;
 
-        if(entry.coefficients.size() < min_parameters)
+        if(coefficient_count < min_parameters)
         {
-            min_parameters = entry.coefficients.size();
+            min_parameters = coefficient_count;
         }
 
-        if (entry.coefficients.size() > max_parameters)
+        if (coefficient_count > max_parameters)
         {
-            max_parameters = entry.coefficients.size();
+            max_parameters = coefficient_count;
         }
 
-        total_parameters += entry.coefficients.size();
+        total_parameters += coefficient_count;
     }
 
     cout << "Dataset statistics:" << endl;
@@ -298,6 +505,8 @@ static void print_statistics(const parameters_t& parameters, const vector<Entry>
     cout << "Parameters min: " << min_parameters << endl;
     cout << "Parameters max: " << max_parameters << endl;
     cout << "Parameters avg: " << avg_parameters << endl;
+    const auto coefficient_bytes = static_cast<tune_t>(entries.encoded_coefficient_size() * sizeof(CoefficientWord));
+    cout << "Coefficient bytes per entry: " << coefficient_bytes / entries.size() << " (" << coefficient_bytes / total_parameters << " per coefficient)" << endl;
 
     cout << endl;
 }
@@ -375,16 +584,14 @@ static tune_t quiescence(chess::Board& board, const parameters_t& parameters, pv
     }
 
     Entry entry;
+    vector<CoefficientEntry, ArenaAllocator<CoefficientEntry>> coefficients;
     entry.white_to_move = board.sideToMove() == chess::Color::WHITE;
+    get_coefficient_entries(eval_result.coefficients, coefficients, static_cast<int32_t>(parameters.size()));
 #if TAPERED
-    entry.endgame_scale = eval_result.endgame_scale;
-#endif
-    get_coefficient_entries(eval_result.coefficients, entry.coefficients, static_cast<int32_t>(parameters.size()));
-#if TAPERED
-    entry.phase = get_phase(board);
+    set_phase_weights(entry, get_phase(board), eval_result.endgame_scale);
 #endif
     entry.additional_score = 0;
-    tune_t eval = linear_eval(entry, parameters);
+    tune_t eval = linear_eval(entry, coefficients, parameters);
     if(!entry.white_to_move)
     {
         eval = -eval;
@@ -466,24 +673,8 @@ static tune_t quiescence(chess::Board& board, const parameters_t& parameters, pv
     return best_score;
 }
 
-string cleanup_fen(const string& initial_fen)
-{
-    int space_count = 0;
-    size_t pos = 0;
-    for (size_t i = 0; i < initial_fen.size(); ++i) {
-        if (initial_fen[i] == ' ') {
-            ++space_count;
-        }
-        if (space_count == 4) {
-            pos = i;
-            break;
-        }
-    }
-    const auto clean_fen = initial_fen.substr(0, pos);
-    return clean_fen;
-}
-
-chess::Board quiescence_root(const parameters_t& parameters, chess::Board board)
+// Plays the principal variation of the quiescence search on board
+static void quiescence_root(const parameters_t& parameters, chess::Board& board)
 {
     pv_table_t pv_table {};
     auto score = quiescence(board, parameters, pv_table, -inf, inf, 0);
@@ -508,32 +699,39 @@ chess::Board quiescence_root(const parameters_t& parameters, chess::Board board)
     {
         board.makeMove(pv_table[0].moves[pv_index]);
     }
+}
 
+// Boards are reused by each load thread and set from the tokens, neither a new board nor setFen is needed per position
+static const chess::Board& get_thread_board(const FenTokens& tokens)
+{
+    thread_local FenBoard board;
+    board.set_tokens(tokens);
     return board;
 }
 
-static void parse_fen(const bool side_to_move_wdl, const parameters_t& parameters, vector<Entry>& entries, const string& original_fen)
+static void push_entry(const parameters_t& parameters, EntryList& entries, const EvalResult& eval_result, Entry& entry)
 {
-    if constexpr (TuneEval::print_data_entries)
-    {
-        cout << original_fen;
-    }
-
-    //string fen;
-    const auto clean_fen = cleanup_fen(original_fen);
-    chess::Board board = chess::Board(clean_fen);
+    // Gathered per load thread and copied into the entry list's coefficient array
+    thread_local vector<CoefficientEntry> coefficients;
+    coefficients.clear();
 
-    if constexpr (TuneEval::filter_in_check)
+    get_coefficient_entries(eval_result.coefficients, coefficients, static_cast<int32_t>(parameters.size()));
+    entry.additional_score = 0;
+    if constexpr (TuneEval::includes_additional_score)
     {
-        if (board.inCheck())
-            return;
+        const tune_t score = linear_eval(entry, coefficients, parameters);
+        if constexpr (TuneEval::print_data_entries)
+        {
+            cout << " Eval: " << score << endl;
+        }
+        entry.additional_score = eval_result.score - score;
     }
 
-    if constexpr (TuneEval::enable_qsearch)
-    {
-        board = quiescence_root(parameters, board);
-    }
+    entries.push_back(entry, coefficients);
+}
 
+static void add_entry(const parameters_t& parameters, EntryList& entries, const chess::Board& board, const tune_t wdl)
+{
     EvalResult eval_result;
     if constexpr (TuneEval::supports_external_chess_eval)
     {
@@ -548,304 +746,1576 @@ static void parse_fen(const bool side_to_move_wdl, const parameters_t& parameter
     Entry entry;
     //entry.white_to_move = get_fen_color_to_move(fen);
     entry.white_to_move = board.sideToMove() == chess::Color::WHITE;
+    entry.wdl = wdl;
+    entry.key = board.hash();
 #if TAPERED
-    entry.endgame_scale = eval_result.endgame_scale;
+    set_phase_weights(entry, get_phase(board), eval_result.endgame_scale);
 #endif
-    const bool original_white_to_move = get_fen_color_to_move(original_fen);
-    //cout << (entry.white_to_move ? "w" : "b") << " ";
-    entry.wdl = get_fen_wdl(original_fen, original_white_to_move, entry.white_to_move, side_to_move_wdl);
-    get_coefficient_entries(eval_result.coefficients, entry.coefficients, static_cast<int32_t>(parameters.size()));
+    push_entry(parameters, entries, eval_result, entry);
+}
+
+// Without qsearch or the in-check filter nothing needs a board, the FEN goes to the eval as it is and the phase is counted from it
+static void add_fen_entry(const parameters_t& parameters, EntryList& entries, const FenTokens& tokens, const tune_t wdl)
+{
+    // Reused by each load thread, so handing the eval a string does not allocate per line
+    thread_local string fen;
+    fen.assign(tokens.position);
+    const auto eval_result = TuneEval::get_fen_eval_result(fen);
+
+    Entry entry;
+    entry.white_to_move = tokens.white_to_move;
+    entry.wdl = wdl;
+    // Keys are only needed to find duplicates, and only a board computes them the same way for every data format
+    entry.key = enable_deduplication ? get_thread_board(tokens).hash() : 0;
 #if TAPERED
-    entry.phase = get_phase(board);
+    set_phase_weights(entry, get_phase(tokens.board), eval_result.endgame_scale);
 #endif
-    entry.additional_score = 0;
-    if constexpr (TuneEval::includes_additional_score)
+    push_entry(parameters, entries, eval_result, entry);
+}
+
+// Returns false when the position is filtered out and no entry is added
+static bool parse_board(const parameters_t& parameters, EntryList& entries, const chess::Board& board, const tune_t wdl)
+{
+    const ArenaMark arena_mark;
+    if constexpr (TuneEval::filter_in_check)
     {
-        const tune_t score = linear_eval(entry, parameters);
-        if constexpr (TuneEval::print_data_entries)
-        {
-            cout << " Eval: " << score << endl;
-        }
-        entry.additional_score = eval_result.score - score;
+        if (board.inCheck())
+            return false;
     }
 
-    entries.push_back(entry);
+    if constexpr (TuneEval::enable_qsearch)
+    {
+        // Copy assigned, so the searched board reuses the buffers of the previous position
+        thread_local chess::Board quiet_board;
+        quiet_board = board;
+        quiescence_root(parameters, quiet_board);
+        add_entry(parameters, entries, quiet_board, wdl);
+    }
+    else
+    {
+        add_entry(parameters, entries, board, wdl);
+    }
+    return true;
 }
 
-static void read_fens(const DataSource& source, const high_resolution_clock::time_point start, vector<string>& fens)
+static void parse_fen(const bool side_to_move_wdl, const parameters_t& parameters, EntryList& entries, const string_view original_fen)
 {
-    cout << "Reading " << source.path;
-    if (source.position_limit > 0)
+    if constexpr (TuneEval::print_data_entries)
     {
-        cout << " (" << source.position_limit << " positions)";
+        cout << original_fen;
     }
-    cout << "..." << endl;
 
-    ifstream file(source.path);
-    if (!file)
+    const ArenaMark arena_mark;
+    const auto tokens = tokenize_fen(original_fen);
+    const auto wdl = !tokens.white_to_move && side_to_move_wdl ? 1 - tokens.wdl : tokens.wdl;
+    if constexpr (TuneEval::enable_qsearch || TuneEval::filter_in_check)
     {
-        cout << "Failed to open " << source.path << endl;
-        throw runtime_error("Failed to open data source");
+        parse_board(parameters, entries, get_thread_board(tokens), wdl);
     }
+    else
+    {
+        add_fen_entry(parameters, entries, tokens, wdl);
+    }
+}
 
-    while (!file.eof())
+struct FenChunk
+{
+    size_t load_index;
+    // Position of the chunk within its source, entries are stored in this order
+    size_t chunk_index;
+    string text;
+    vector<size_t> line_ends;
+    // Entries of a chunk parsed before the chunks ahead of it were stored, held until they are
+    EntryList entries;
+};
+
+// Lines per chunk handed from the reader to the parse workers, and how many chunks may be in flight at once
+constexpr size_t fen_chunk_size = 10000;
+constexpr size_t fen_chunk_count = 64;
+
+// Bytes pulled from the source reader at a time, lines straddling two blocks are carried over
+constexpr size_t fen_read_block_size = 1 << 20;
+
+// wait_for_room is called before each chunk is started
+static int64_t read_fens(const DataSource& source, const size_t load_index, SourceReader& reader, BoundedQueue<FenChunk*>& free_chunks, BoundedQueue<FenChunk*>& full_chunks, const function<void()>& wait_for_room)
+{
+    int64_t position_count = 0;
+    size_t chunk_count = 0;
+    FenChunk* chunk = nullptr;
+    const auto add_line = [&](const string_view original_fen)
     {
-        if (source.position_limit > 0 && fens.size() >= source.position_limit)
+        if (source.position_limit > 0 && position_count >= source.position_limit)
         {
-            break;
+            return false;
         }
 
-        string original_fen;
-        getline(file, original_fen);
         if (original_fen.empty())
         {
-            break;
+            return true;
         }
 
-        fens.push_back(original_fen);
-    }
-
-    print_elapsed(start);
-    std::cout << "Read " << fens.size() << " positions from " << source.path << endl;
-}
+        if (chunk == nullptr)
+        {
+            wait_for_room();
+            chunk = free_chunks.pop();
+            chunk->load_index = load_index;
+            chunk->chunk_index = chunk_count++;
+        }
+        chunk->text += original_fen;
+        chunk->line_ends.push_back(chunk->text.size());
+        position_count++;
 
-static void parse_fens(ThreadPool& thread_pool, const DataSource& source, const vector<string>& fens, const parameters_t& parameters, const high_resolution_clock::time_point time_start, vector<Entry>& entries)
-{
-    cout << "Parsing " << fens.size() << " positions..." << endl;
-    array<vector<Entry>, data_load_thread_count> thread_entries;
-    const auto side_to_move_wdl = source.side_to_move_wdl;
-    constexpr int batch_size = 10000;
-    mutex mut;
-    queue<vector<string>> batches;
-    vector<string> current_batch;
-    for(const auto& fen : fens)
-    {
-        current_batch.push_back(fen);
-        if (current_batch.size() == batch_size)
+        if (chunk->line_ends.size() == fen_chunk_size)
         {
-            batches.emplace(current_batch);
-            current_batch.clear();
+            full_chunks.push(chunk);
+            chunk = nullptr;
         }
-    }
-    if(!current_batch.empty())
-    {
-        batches.emplace(current_batch);
-    }
+        return true;
+    };
 
-    for (int thread_id = 0; thread_id < data_load_thread_count; thread_id++)
+    vector<char> buffer(fen_read_block_size);
+    string partial_line;
+    bool reading = true;
+    while (reading)
     {
-        thread_pool.enqueue([thread_id, &thread_entries, &mut, side_to_move_wdl, parameters, &batches, time_start]()
+        const auto read_size = reader.read(buffer.data(), buffer.size());
+        if (read_size == 0)
         {
-            vector<Entry> entries;
-
-            int position_count = 0;
-            while(true)
+            if (!partial_line.empty())
             {
-                vector<string> thread_batch;
-                {
-                    lock_guard lock(mut);
-                    if(batches.empty())
-                    {
-                        break;
-                    }
-                    thread_batch = batches.front();
-                    batches.pop();
-                }
+                add_line(partial_line);
+            }
+            break;
+        }
 
-                constexpr auto thread_data_load_print_interval = TuneEval::data_load_print_interval / data_load_thread_count;
-                for(auto& fen : thread_batch)
-                {
-                    parse_fen(side_to_move_wdl, parameters, entries, fen);
-                    position_count++;
-                    if (thread_id == 0 && position_count % thread_data_load_print_interval == 0)
-                    {
-                        print_elapsed(time_start);
-                        std::cout << "Parsed ~" << position_count * data_load_thread_count << " positions..." << endl;
-                    }
-                }
+        const string_view block(buffer.data(), read_size);
+        size_t line_start = 0;
+        while (reading)
+        {
+            const auto newline = block.find('\n', line_start);
+            if (newline == string_view::npos)
+            {
+                partial_line.append(block.substr(line_start));
+                break;
             }
 
-            thread_entries[thread_id] = entries;
-        });
+            const auto line = block.substr(line_start, newline - line_start);
+            if (partial_line.empty())
+            {
+                reading = add_line(line);
+            }
+            else
+            {
+                partial_line.append(line);
+                reading = add_line(partial_line);
+                partial_line.clear();
+            }
+            line_start = newline + 1;
+        }
+    }
+
+    if (chunk != nullptr)
+    {
+        full_chunks.push(chunk);
+    }
+
+    return position_count;
+}
+
+// Bounds for the byte ranges a mapped source is split into, ranges are handed out to the load threads one at a time
+constexpr size_t min_fen_range_size = 64 << 10;
+constexpr size_t max_fen_range_size = 4 << 20;
+
+static size_t find_position_limit_end(const string_view text, const int64_t position_limit)
+{
+    int64_t position_count = 0;
+    size_t line_start = 0;
+    while (line_start < text.size() && position_count < position_limit)
+    {
+        const auto newline = text.find('\n', line_start);
+        const auto line_end = newline == string_view::npos ? text.size() : newline;
+        if (line_end > line_start)
+        {
+            position_count++;
+        }
+        line_start = line_end + 1;
+    }
+    return min(line_start, text.size());
+}
+
+static size_t find_line_start(const string_view text, const size_t offset)
+{
+    const auto newline = text.find('\n', offset);
+    return newline == string_view::npos ? string_view::npos : newline + 1;
+}
+
+template<typename FindBoundary>
+static vector<size_t> split_ranges(const string_view text, FindBoundary find_boundary)
+{
+    // Several ranges per thread, so a thread that got slow lines does not hold up the others at the end
+    const auto range_size = clamp(text.size() / (data_load_thread_count * 16), min_fen_range_size, max_fen_range_size);
+    vector<size_t> boundaries{0};
+    while (boundaries.back() + range_size < text.size())
+    {
+        const auto boundary = find_boundary(text, boundaries.back() + range_size);
+        if (boundary == string_view::npos || boundary >= text.size())
+        {
+            break;
+        }
+        boundaries.push_back(boundary);
+    }
+    boundaries.push_back(text.size());
+    return boundaries;
+}
+
+static int64_t parse_fen_range(const DataSource& source, const parameters_t& parameters, const string_view text, EntryList& entries)
+{
+    int64_t position_count = 0;
+    size_t line_start = 0;
+    while (line_start < text.size())
+    {
+        const auto newline = text.find('\n', line_start);
+        const auto line_end = newline == string_view::npos ? text.size() : newline;
+        if (line_end > line_start)
+        {
+            parse_fen(source.side_to_move_wdl, parameters, entries, text.substr(line_start, line_end - line_start));
+            position_count++;
+        }
+        line_start = line_end + 1;
+    }
+    return position_count;
+}
+
+// Exposes a range of a mapped file as an input stream without copying it
+class ViewStreamBuffer : public streambuf {
+public:
+    explicit ViewStreamBuffer(const string_view text)
+    {
+        const auto data = const_cast<char*>(text.data());
+        setg(data, data, data + text.size());
+    }
+};
+
+// Replays the games of a PGN and feeds the sampled positions to parse_board
+class PgnSampler : public chess::pgn::Visitor {
+public:
+    PgnSampler(const parameters_t& parameters, EntryList& entries)
+        : parameters(parameters), entries(entries)
+    {
+    }
+
+    int64_t position_count() const
+    {
+        return sampled_count;
+    }
+
+    void startPgn() override
+    {
+        board = chess::Board();
+        wdl = -1;
+        ply = 0;
+    }
+
+    void header(const string_view key, const string_view value) override
+    {
+        if (key == "Result")
+        {
+            if (value == "1-0")
+            {
+                wdl = 1;
+            }
+            else if (value == "1/2-1/2")
+            {
+                wdl = 0.5;
+            }
+            else if (value == "0-1")
+            {
+                wdl = 0;
+            }
+        }
+        else if (key == "FEN")
+        {
+            board = chess::Board(value);
+        }
+    }
+
+    void startMoves() override
+    {
+        // Unfinished games carry no result to learn from
+        if (wdl < 0)
+        {
+            skipPgn(true);
+        }
+    }
+
+    void move(const string_view san, [[maybe_unused]] const string_view comment) override
+    {
+        chess::Move move;
+        try
+        {
+            move = chess::uci::parseSan(board, san);
+        }
+        catch (const std::exception&)
+        {
+            cout << "Skipping the rest of a game with illegal move " << san << endl;
+            skipPgn(true);
+            return;
+        }
+
+        if (ply >= pgn_skip_plies && (ply - pgn_skip_plies) % pgn_sample_interval == 0)
+        {
+            const bool noisy = board.inCheck() || board.isCapture(move);
+            if (!pgn_filter_noisy || !noisy)
+            {
+                if constexpr (TuneEval::print_data_entries)
+                {
+                    cout << board.getFen();
+                }
+                // The position limit counts only positions that make it into the entries
+                if (parse_board(parameters, entries, board, wdl))
+                {
+                    sampled_count++;
+                }
+            }
+        }
+
+        board.makeMove(move);
+        ply++;
+    }
+
+    void endPgn() override
+    {
+    }
+
+private:
+    const parameters_t& parameters;
+    EntryList& entries;
+    chess::Board board;
+    tune_t wdl = -1;
+    int32_t ply = 0;
+    int64_t sampled_count = 0;
+};
+
+static size_t find_pgn_game_start(const string_view text, size_t offset)
+{
+    // A tag line right after an empty line starts a new game, other tag lines belong to the headers of the current one
+    while (true)
+    {
+        const auto tag = text.find("\n[", offset);
+        if (tag == string_view::npos)
+        {
+            return string_view::npos;
+        }
+
+        auto line_end = tag;
+        if (line_end > 0 && text[line_end - 1] == '\r')
+        {
+            line_end--;
+        }
+        if (line_end > 0 && text[line_end - 1] == '\n')
+        {
+            return tag + 1;
+        }
+
+        offset = tag + 1;
+    }
+}
+
+template<typename Record>
+static int64_t parse_packed_range(const parameters_t& parameters, const string_view range, EntryList& entries)
+{
+    PackedBoard board;
+    const auto record_count = range.size() / sizeof(Record);
+    for (size_t record_index = 0; record_index < record_count; record_index++)
+    {
+        Record record;
+        memcpy(&record, range.data() + record_index * sizeof(Record), sizeof(Record));
+        const auto wdl = board.set_record(record);
+        if constexpr (TuneEval::print_data_entries)
+        {
+            cout << board.getFen();
+        }
+        parse_board(parameters, entries, board, wdl);
+    }
+    return static_cast<int64_t>(record_count);
+}
+
+// A data source being loaded. Mapped sources are split into ranges for the load workers, the others are streamed by the reader thread.
+struct SourceLoad
+{
+    const DataSource* source = nullptr;
+    string cache_path;
+    EntryCacheKey cache_key{};
+    bool cached = false;
+    bool streamed = false;
+    MappedFile file;
+    string_view text;
+    vector<size_t> boundaries;
+    // Results of mapped sources are kept per range and appended in range order, so the entry order does not depend on thread timing
+    vector<EntryList> range_entries;
+    mutex entries_mutex;
+    EntryList entries;
+    atomic<int64_t> position_count = 0;
+    // Out-of-core loading writes the entries to the shards as they are parsed instead of keeping them, the count is guarded by entries_mutex
+    EntryShards* shards = nullptr;
+    int64_t shard_entry_count = 0;
+    // Ranges finish out of order, so the finished ranges at the start of the file are tracked. With shards those are written out
+    // and freed. PGN sources only know how many positions a range holds once it is sampled, their later ranges are skipped
+    // once the entries of those cover the position limit.
+    vector<bool> finished_ranges;
+    size_t finished_range_prefix = 0;
+    atomic<int64_t> finished_prefix_entry_count = 0;
+    // Streamed chunks finish out of order as well, the ones parsed ahead are held here until the chunks before them are stored
+    map<size_t, FenChunk*> parsed_chunks;
+    size_t next_chunk_index = 0;
+    // Bytes of the entries held for the ranges or chunks before them. With shards no range or chunk is started while
+    // they take up half the memory limit, the shard being filled takes the other half.
+    size_t held_memory_size = 0;
+    condition_variable held_memory_condition;
+};
+
+// Chunks are recycled between the reader and the workers, so memory stays bounded by fen_chunk_count chunks for all streamed sources together
+struct FenStream
+{
+    vector<FenChunk> chunks = vector<FenChunk>(fen_chunk_count);
+    BoundedQueue<FenChunk*> free_chunks = BoundedQueue<FenChunk*>(fen_chunk_count);
+    BoundedQueue<FenChunk*> full_chunks = BoundedQueue<FenChunk*>(fen_chunk_count);
+    atomic<bool> reading_done = false;
+};
+
+static void print_source_reading(const DataSource& source)
+{
+    cout << "Reading " << source.path;
+    if (source.position_limit > 0)
+    {
+        cout << " (" << source.position_limit << " positions)";
+    }
+    cout << "..." << endl;
+}
+
+static void prepare_source(SourceLoad& load, const parameters_t& parameters)
+{
+    const auto& source = *load.source;
+    // The cache is read and written whole, which out-of-core loading avoids
+    if (enable_entry_cache && load.shards == nullptr)
+    {
+        load.cache_path = get_entry_cache_path(source);
+        load.cache_key = get_entry_cache_key(source, parameters);
+        load.cached = load_entry_cache(load.cache_path, load.cache_key, load.entries);
+        if (load.cached)
+        {
+            return;
+        }
+    }
+
+    // Compressed sources cannot be parsed in place and always go through the streaming reader
+    if (source.format == DataFormat::Epd && (detect_compression(source.path) != Compression::None || !load.file.open(source.path)))
+    {
+        load.streamed = true;
+        return;
+    }
+
+    if (!load.file.is_open() && !load.file.open(source.path))
+    {
+        cout << "Failed to open " << source.path << endl;
+        throw runtime_error("Failed to open data source");
+    }
+
+    load.text = string_view(load.file.data(), load.file.size());
+    if (source.format == DataFormat::Pgn)
+    {
+        // Games are sharded across the load threads, each range starts at the first tag of a game
+        load.boundaries = split_ranges(load.text, find_pgn_game_start);
+    }
+    else if (source.format == DataFormat::Marlin || source.format == DataFormat::Bullet)
+    {
+        // Both packed formats use 32 byte records
+        constexpr size_t record_size = sizeof(MarlinRecord);
+        static_assert(sizeof(BulletRecord) == record_size);
+        if (load.text.size() % record_size != 0)
+        {
+            cout << "Ignoring " << load.text.size() % record_size << " trailing bytes of " << source.path << endl;
+            load.text = load.text.substr(0, load.text.size() - load.text.size() % record_size);
+        }
+        if (source.position_limit > 0)
+        {
+            load.text = load.text.substr(0, min(load.text.size(), static_cast<size_t>(source.position_limit) * record_size));
+        }
+        load.boundaries = split_ranges(load.text, [](const string_view, const size_t offset)
+        {
+            return (offset + record_size - 1) / record_size * record_size;
+        });
+    }
+    else
+    {
+        if (source.position_limit > 0)
+        {
+            load.text = load.text.substr(0, find_position_limit_end(load.text, source.position_limit));
+        }
+        load.boundaries = split_ranges(load.text, find_line_start);
+    }
+    load.range_entries.resize(load.boundaries.size() - 1);
+    if (load.shards != nullptr || (source.format == DataFormat::Pgn && source.position_limit > 0))
+    {
+        load.finished_ranges.resize(load.range_entries.size());
+    }
+}
+
+static int64_t parse_range_entries(SourceLoad& load, const size_t range_index, const parameters_t& parameters, EntryList& entries)
+{
+    const auto& source = *load.source;
+    const auto range = load.text.substr(load.boundaries[range_index], load.boundaries[range_index + 1] - load.boundaries[range_index]);
+    switch (source.format)
+    {
+    case DataFormat::Pgn:
+    {
+        ViewStreamBuffer buffer(range);
+        istream stream(&buffer);
+        PgnSampler sampler(parameters, entries);
+        const auto parser = make_unique<chess::pgn::StreamParser>(stream);
+        parser->readGames(sampler);
+        return sampler.position_count();
+    }
+    case DataFormat::Marlin:
+        return parse_packed_range<MarlinRecord>(parameters, range, entries);
+    case DataFormat::Bullet:
+        return parse_packed_range<BulletRecord>(parameters, range, entries);
+    case DataFormat::Epd:
+    default:
+        return parse_fen_range(source, parameters, range, entries);
+    }
+}
+
+static bool is_position_limit_covered(const SourceLoad& load)
+{
+    const auto& source = *load.source;
+    return source.format == DataFormat::Pgn && source.position_limit > 0 && load.finished_prefix_entry_count.load(memory_order_relaxed) >= source.position_limit;
+}
+
+static void finish_range(SourceLoad& load, const size_t range_index)
+{
+    if (load.finished_ranges.empty())
+    {
+        return;
+    }
+
+    lock_guard lock(load.entries_mutex);
+    load.finished_ranges[range_index] = true;
+    load.held_memory_size += load.range_entries[range_index].get_kernel_memory_size();
+    int64_t prefix_entry_count = load.finished_prefix_entry_count.load(memory_order_relaxed);
+    while (load.finished_range_prefix < load.finished_ranges.size() && load.finished_ranges[load.finished_range_prefix])
+    {
+        auto& range = load.range_entries[load.finished_range_prefix];
+        load.held_memory_size -= range.get_kernel_memory_size();
+        // finish_source can not truncate entries already written, so the PGN position limit is applied before writing
+        if (load.shards != nullptr && load.source->format == DataFormat::Pgn && load.source->position_limit > 0)
+        {
+            range.truncate(static_cast<size_t>(max<int64_t>(load.source->position_limit - prefix_entry_count, 0)));
+        }
+        prefix_entry_count += static_cast<int64_t>(range.size());
+        if (load.shards != nullptr)
+        {
+            load.shards->append(range);
+            load.shard_entry_count += static_cast<int64_t>(range.size());
+            range = EntryList();
+        }
+        load.finished_range_prefix++;
+    }
+    load.finished_prefix_entry_count.store(prefix_entry_count, memory_order_relaxed);
+    load.held_memory_condition.notify_all();
+}
+
+// Called before a range or chunk of the source is started. The one the held entries wait for was started before them and
+// is parsed by a thread that is not waiting here, so the wait always ends.
+static void wait_for_held_memory(SourceLoad& load)
+{
+    if (load.shards == nullptr)
+    {
+        return;
+    }
+
+    unique_lock lock(load.entries_mutex);
+    load.held_memory_condition.wait(lock, [&load]()
+    {
+        return load.held_memory_size < out_of_core_memory_limit / 2;
+    });
+}
+
+// Parsed into the worker's reused batch list and copied out once, so the range's list is allocated at its final size.
+// Ranges are handed out in file order, so a range not started yet lies after all finished ranges at the start of the file,
+// and is not needed once those cover the position limit.
+static int64_t parse_source_range(SourceLoad& load, const size_t range_index, const parameters_t& parameters, EntryList& batch_entries)
+{
+    if (is_position_limit_covered(load))
+    {
+        return 0;
+    }
+
+    const auto position_count = parse_range_entries(load, range_index, parameters, batch_entries);
+    load.range_entries[range_index].append(batch_entries);
+    batch_entries.clear();
+    finish_range(load, range_index);
+    return position_count;
+}
+
+static void store_chunk_entries(SourceLoad& load, const EntryList& chunk_entries)
+{
+    if (load.shards != nullptr)
+    {
+        load.shards->append(chunk_entries);
+        load.shard_entry_count += static_cast<int64_t>(chunk_entries.size());
+    }
+    else
+    {
+        load.entries.append(chunk_entries);
+    }
+}
+
+static void recycle_chunk(FenChunk& chunk, BoundedQueue<FenChunk*>& free_chunks)
+{
+    chunk.text.clear();
+    chunk.line_ends.clear();
+    free_chunks.push(&chunk);
+}
+
+// Chunks are stored in source order, so the entry order does not depend on thread timing. A chunk parsed ahead keeps
+// its entries and is only recycled once stored, so the reader can not get more than fen_chunk_count chunks ahead.
+static int64_t parse_fen_chunk(SourceLoad& load, FenChunk& chunk, const parameters_t& parameters, EntryList& chunk_entries, BoundedQueue<FenChunk*>& free_chunks)
+{
+    const string_view text = chunk.text;
+    size_t line_start = 0;
+    for (const auto line_end : chunk.line_ends)
+    {
+        parse_fen(load.source->side_to_move_wdl, parameters, chunk_entries, text.substr(line_start, line_end - line_start));
+        line_start = line_end;
+    }
+    const auto position_count = static_cast<int64_t>(chunk.line_ends.size());
+
+    {
+        lock_guard lock(load.entries_mutex);
+        if (chunk.chunk_index != load.next_chunk_index)
+        {
+            chunk.entries.append(chunk_entries);
+            load.held_memory_size += chunk.entries.get_kernel_memory_size();
+            load.parsed_chunks.emplace(chunk.chunk_index, &chunk);
+            chunk_entries.clear();
+            return position_count;
+        }
+
+        store_chunk_entries(load, chunk_entries);
+        recycle_chunk(chunk, free_chunks);
+        load.next_chunk_index++;
+        for (auto held = load.parsed_chunks.begin(); held != load.parsed_chunks.end() && held->first == load.next_chunk_index; held = load.parsed_chunks.erase(held))
+        {
+            auto& held_chunk = *held->second;
+            load.held_memory_size -= held_chunk.entries.get_kernel_memory_size();
+            store_chunk_entries(load, held_chunk.entries);
+            held_chunk.entries = EntryList();
+            recycle_chunk(held_chunk, free_chunks);
+            load.next_chunk_index++;
+        }
+    }
+    load.held_memory_condition.notify_all();
+    chunk_entries.clear();
+
+    return position_count;
+}
+
+static void read_streamed_sources(vector<SourceLoad>& loads, FenStream& stream)
+{
+    for (size_t load_index = 0; load_index < loads.size(); load_index++)
+    {
+        if (loads[load_index].streamed)
+        {
+            auto& load = loads[load_index];
+            SourceReader reader(load.source->path, detect_compression(load.source->path));
+            read_fens(*load.source, load_index, reader, stream.free_chunks, stream.full_chunks, [&load]()
+            {
+                wait_for_held_memory(load);
+            });
+        }
+    }
+}
+
+// Shared by all sources: streamed chunks are taken first so the reader never stalls, then ranges of the mapped sources in source order.
+// A worker only leaves once every range is taken and the reader is done, so no load thread idles while any source has unread data.
+static void load_worker(vector<SourceLoad>& loads, const vector<pair<size_t, size_t>>& ranges, atomic<size_t>& next_range, FenStream& stream, const parameters_t& parameters, const high_resolution_clock::time_point start, atomic<int64_t>& parsed_count, atomic<uint64_t>& allocation_count)
+{
+    const auto first_allocation_count = get_thread_allocation_count();
+    // Temporaries of each position come from the arena and are freed once the position is stored,
+    // the batch list is cleared and reused for every chunk and range
+    Arena arena;
+    const ThreadArenaScope arena_scope(arena);
+    EntryList batch_entries;
+    int32_t idle_attempt = 0;
+    while (true)
+    {
+        int64_t position_count;
+
+        // The reader publishes its last chunk before setting the flag, so a failed pop after seeing it is conclusive.
+        // The push count is read first, so a chunk or the flag arriving after these checks ends the wait below.
+        const auto push_count = stream.full_chunks.get_push_count();
+        const bool reading_done = stream.reading_done.load(memory_order_acquire);
+        FenChunk* chunk;
+        if (stream.full_chunks.try_pop(chunk))
+        {
+            auto& load = loads[chunk->load_index];
+            position_count = parse_fen_chunk(load, *chunk, parameters, batch_entries, stream.free_chunks);
+            load.position_count += position_count;
+        }
+        else if (const auto peeked_range = next_range.load(); peeked_range < ranges.size())
+        {
+            // Waits before taking a range, a thread waiting with a range taken could hold up the range the others wait for
+            wait_for_held_memory(loads[ranges[peeked_range].first]);
+            const auto range_index = next_range.fetch_add(1);
+            if (range_index >= ranges.size())
+            {
+                continue;
+            }
+
+            auto& load = loads[ranges[range_index].first];
+            position_count = parse_source_range(load, ranges[range_index].second, parameters, batch_entries);
+            load.position_count += position_count;
+        }
+        else if (reading_done)
+        {
+            break;
+        }
+        else
+        {
+            stream.full_chunks.wait_for_push(push_count, idle_attempt++);
+            continue;
+        }
+        idle_attempt = 0;
+
+        const auto parsed = parsed_count.fetch_add(position_count) + position_count;
+        if (parsed / TuneEval::data_load_print_interval != (parsed - position_count) / TuneEval::data_load_print_interval)
+        {
+            print_elapsed(start);
+            std::cout << "Parsed ~" << parsed << " positions..." << endl;
+        }
+    }
+
+    allocation_count += get_thread_allocation_count() - first_allocation_count;
+}
+
+// Appends the entries of a source to the final list in range order, the list is sized for all sources up front
+// Returns the number of entries of the source, which were written to the shards already with out-of-core loading
+static size_t finish_source(SourceLoad& load, EntryList& entries)
+{
+    const auto& source = *load.source;
+    const auto first_entry = entries.size();
+    entries.append(load.entries);
+    load.entries = EntryList();
+    for (auto& range : load.range_entries)
+    {
+        entries.append(range);
+        range = EntryList();
+    }
+    load.file.close();
+
+    if (load.cached)
+    {
+        return entries.size() - first_entry;
+    }
+
+    // Ranges are merged in file order, so the limit keeps the positions sampled from the first games
+    int64_t position_count = load.position_count;
+    if (source.format == DataFormat::Pgn && source.position_limit > 0)
+    {
+        entries.truncate(first_entry + source.position_limit);
+        position_count = min(position_count, source.position_limit);
+    }
+
+    const auto entry_count = load.shards != nullptr ? static_cast<size_t>(load.shard_entry_count) : entries.size() - first_entry;
+    cout << (source.format == DataFormat::Pgn ? "Sampled " : "Read ") << position_count << " positions from " << source.path << ", " << entry_count << " entries" << endl;
+
+    if (enable_entry_cache && load.shards == nullptr)
+    {
+        save_entry_cache(load.cache_path, load.cache_key, entries, first_entry);
+        cout << "Wrote entry cache " << load.cache_path << endl;
+    }
+    return entry_count;
+}
+
+// With shards the entries are written to them while the sources are parsed, and entries is left as it is
+static void load_sources(ThreadPool& thread_pool, const vector<DataSource>& sources, const parameters_t& parameters, const high_resolution_clock::time_point start, EntryList& entries, EntryShards* const shards = nullptr)
+{
+    // Cache lookups hash every source file, so the sources are prepared in parallel as well
+    vector<SourceLoad> loads(sources.size());
+    for (size_t load_index = 0; load_index < loads.size(); load_index++)
+    {
+        loads[load_index].source = &sources[load_index];
+        loads[load_index].shards = shards;
+        thread_pool.enqueue([&loads, &parameters, load_index]()
+        {
+            prepare_source(loads[load_index], parameters);
+        });
+    }
+    thread_pool.wait_for_completion();
+
+    vector<pair<size_t, size_t>> ranges;
+    bool has_streamed_sources = false;
+    for (size_t load_index = 0; load_index < loads.size(); load_index++)
+    {
+        const auto& load = loads[load_index];
+        if (load.cached)
+        {
+            cout << "Loaded " << load.entries.size() << " entries from " << load.cache_path << endl;
+            continue;
+        }
+
+        print_source_reading(*load.source);
+        has_streamed_sources |= load.streamed;
+        for (size_t range_index = 0; range_index + 1 < load.boundaries.size(); range_index++)
+        {
+            ranges.emplace_back(load_index, range_index);
+        }
+    }
+
+    FenStream stream;
+    for (auto& chunk : stream.chunks)
+    {
+        chunk.line_ends.reserve(fen_chunk_size);
+        stream.free_chunks.try_push(&chunk);
+    }
+    stream.reading_done = !has_streamed_sources;
+
+    atomic<size_t> next_range = 0;
+    atomic<int64_t> parsed_count = 0;
+    atomic<uint64_t> allocation_count = 0;
+    for (int thread_id = 0; thread_id < data_load_thread_count; thread_id++)
+    {
+        thread_pool.enqueue([&]()
+        {
+            load_worker(loads, ranges, next_range, stream, parameters, start, parsed_count, allocation_count);
+        });
+    }
+
+    // Reading and decompression get their own thread, the pool may have no thread left over for it once the workers are running
+    exception_ptr read_error;
+    thread reader_thread;
+    if (has_streamed_sources)
+    {
+        reader_thread = thread([&]()
+        {
+            try
+            {
+                read_streamed_sources(loads, stream);
+            }
+            catch (...)
+            {
+                read_error = current_exception();
+            }
+            stream.reading_done.store(true, memory_order_release);
+            stream.full_chunks.wake_consumers();
+        });
+        reader_thread.join();
+    }
+    thread_pool.wait_for_completion();
+
+    if (read_error)
+    {
+        cout << "Failed to read streamed data sources" << endl;
+        rethrow_exception(read_error);
+    }
+
+    print_elapsed(start);
+    cout << "Parsed " << parsed_count << " positions from " << ranges.size() << " ranges" << (has_streamed_sources ? " and streamed sources" : "") << endl;
+    if constexpr (allocation_stats)
+    {
+        cout << "Load threads made " << allocation_count << " heap allocations" << endl;
+    }
+
+    size_t entry_count = 0;
+    size_t coefficient_size = 0;
+    for (const auto& load : loads)
+    {
+        entry_count += load.entries.size();
+        coefficient_size += load.entries.encoded_coefficient_size();
+        for (const auto& range : load.range_entries)
+        {
+            entry_count += range.size();
+            coefficient_size += range.encoded_coefficient_size();
+        }
+    }
+
+    entries.reserve(entries.size() + entry_count, entries.encoded_coefficient_size() + coefficient_size);
+    size_t loaded_count = 0;
+    for (auto& load : loads)
+    {
+        loaded_count += finish_source(load, entries);
+    }
+    print_elapsed(start);
+    cout << "Loaded " << loaded_count << " entries from " << loads.size() << " data sources" << endl;
+}
+
+// Kahan summation, keeps float sums over millions of entries close to their double counterparts
+template<typename T>
+struct CompensatedSum
+{
+    T sum = 0;
+    T compensation = 0;
+
+    CompensatedSum& operator+=(const T value)
+    {
+        const T corrected = value - compensation;
+        const T next = sum + corrected;
+        compensation = (next - sum) - corrected;
+        sum = next;
+        return *this;
+    }
+
+    explicit operator tune_t() const { return sum; }
+};
+
+// The kernels read the parameters in their own precision, converted is only filled in when that differs from tune_t.
+// The parameters of the dense slots are gathered so the dense part of the evaluation reads them contiguously.
+template<typename Scalar>
+static const KernelParameters<Scalar>& get_kernel_parameters(const parameters_t& parameters, const span<const uint32_t> dense_indices, KernelParameters<Scalar>& kernel_parameters)
+{
+    if constexpr (is_same_v<Scalar, tune_t>)
+    {
+        kernel_parameters.sparse = &parameters;
+    }
+    else
+    {
+        auto& converted = kernel_parameters.converted;
+        converted.resize(parameters.size());
+        for (size_t parameter_index = 0; parameter_index < parameters.size(); parameter_index++)
+        {
+#if TAPERED
+            converted[parameter_index][static_cast<int32_t>(PhaseStages::Midgame)] = static_cast<Scalar>(parameters[parameter_index][static_cast<int32_t>(PhaseStages::Midgame)]);
+            converted[parameter_index][static_cast<int32_t>(PhaseStages::Endgame)] = static_cast<Scalar>(parameters[parameter_index][static_cast<int32_t>(PhaseStages::Endgame)]);
+#else
+            converted[parameter_index] = static_cast<Scalar>(parameters[parameter_index]);
+#endif
+        }
+        kernel_parameters.sparse = &converted;
+    }
+
+    if constexpr (TAPERED && is_same_v<Scalar, double>)
+    {
+        kernel_parameters.vector_kernels = get_vector_kernels(max_kernel_isa);
+    }
+
+    kernel_parameters.dense.resize(dense_indices.size());
+    for (size_t slot = 0; slot < dense_indices.size(); slot++)
+    {
+        kernel_parameters.dense[slot] = (*kernel_parameters.sparse)[dense_indices[slot]];
+    }
+    return kernel_parameters;
+}
+
+static tune_t get_total_weight(const EntryList& entries)
+{
+    tune_t total_weight = 0;
+    for (const auto weight : entries.get_weights())
+    {
+        total_weight += weight;
+    }
+    return total_weight;
+}
+
+// Items [first, last) of part part_index when count items are split into part_count parts, the last part also takes the remainder
+static pair<size_t, size_t> get_part_range(const size_t count, const size_t part_index, const size_t part_count)
+{
+    const auto items_per_part = count / part_count;
+    const auto first = part_index * items_per_part;
+    const auto last = part_index == part_count - 1 ? count : (part_index + 1) * items_per_part;
+    return {first, last};
+}
+
+// Entries [first, last) a thread evaluates in the epoch kernels
+static pair<size_t, size_t> get_thread_entry_range(const size_t entry_count, const int thread_id)
+{
+    return get_part_range(entry_count, thread_id, thread_count);
+}
+
+// Entries whose sigmoids the epoch kernels compute together, so the sigmoid loop is vectorized
+constexpr size_t sigmoid_block_size = 64;
+
+// Evaluations and sigmoids of entries [first_entry, first_entry + count), count is at most sigmoid_block_size
+template<typename Scalar>
+static void get_block_sigmoids(const BasicEntryList<Scalar>& entries, const size_t first_entry, const size_t count, const KernelParameters<Scalar>& parameters, const Scalar K, array<Scalar, sigmoid_block_size>& evals, array<Scalar, sigmoid_block_size>& sigmoids)
+{
+    for (size_t block_index = 0; block_index < count; block_index++)
+    {
+        evals[block_index] = linear_eval(entries, first_entry + block_index, parameters);
+    }
+    compute_sigmoids(K, evals.data(), sigmoids.data(), count, parameters.exact_sigmoid);
+}
+
+// Average error at K and its derivative by K
+struct ErrorSlope
+{
+    tune_t error = 0;
+    tune_t k_derivative = 0;
+};
+
+// Both parts of the slope come from the same pass, the derivative is exact rather than a difference of two errors
+template<typename Scalar, typename Accumulator = tune_t>
+static ErrorSlope get_error_slope(ThreadPool& thread_pool, const BasicEntryList<Scalar>& entries, const tune_t total_weight, const KernelParameters<Scalar>& parameters, const tune_t K)
+{
+    array<ErrorSlope, thread_count> thread_slopes;
+    for(int thread_id = 0; thread_id < thread_count; thread_id++)
+    {
+        thread_pool.enqueue(thread_id, [thread_id, &thread_slopes, &entries, &parameters, K]()
+        {
+            const auto [start, end] = get_thread_entry_range(entries.size(), thread_id);
+            const auto wdls = entries.get_wdls();
+            const auto weights = entries.get_weights();
+            Accumulator error{};
+            Accumulator k_derivative{};
+            array<Scalar, sigmoid_block_size> evals;
+            array<Scalar, sigmoid_block_size> sigmoids;
+            for (size_t block_start = start; block_start < end; block_start += sigmoid_block_size)
+            {
+                const auto block_size = min(sigmoid_block_size, end - block_start);
+                get_block_sigmoids(entries, block_start, block_size, parameters, static_cast<Scalar>(K), evals, sigmoids);
+                for (size_t block_index = 0; block_index < block_size; block_index++)
+                {
+                    const auto i = block_start + block_index;
+                    const auto sig = sigmoids[block_index];
+                    const auto diff = wdls[i] - sig;
+                    error += weights[i] * diff * diff;
+                    k_derivative += static_cast<Scalar>(-2) * weights[i] * diff * sig * (1 - sig) * evals[block_index] / static_cast<Scalar>(400);
+                }
+            }
+            thread_slopes[thread_id] = {static_cast<tune_t>(error), static_cast<tune_t>(k_derivative)};
+        });
     }
 
     thread_pool.wait_for_completion();
 
-    for (int thread_id = 0; thread_id < data_load_thread_count; thread_id++)
-    {
-        for(const Entry& entry : thread_entries[thread_id])
+    ErrorSlope slope;
+    for (int thread_id = 0; thread_id < thread_count; thread_id++)
+    {
+        slope.error += thread_slopes[thread_id].error;
+        slope.k_derivative += thread_slopes[thread_id].k_derivative;
+    }
+    slope.error /= total_weight;
+    slope.k_derivative /= total_weight;
+    return slope;
+}
+
+// Streams the shards through the in-memory kernel, total_weight covers all of them so the shard averages add up
+template<typename Scalar, typename Accumulator = tune_t>
+static ErrorSlope get_error_slope(ThreadPool& thread_pool, EntryShards& shards, const tune_t total_weight, const KernelParameters<Scalar>& parameters, const tune_t K)
+{
+    static_assert(is_same_v<Scalar, tune_t>, "Shards are stored in tune_t");
+    ErrorSlope slope;
+    shards.for_each_shard([&](const EntryList& shard)
+    {
+        const auto shard_slope = get_error_slope<Scalar, Accumulator>(thread_pool, shard, total_weight, parameters, K);
+        slope.error += shard_slope.error;
+        slope.k_derivative += shard_slope.k_derivative;
+    });
+    return slope;
+}
+
+template<typename Entries>
+static tune_t find_optimal_k(ThreadPool& thread_pool, Entries& entries, const tune_t total_weight, const parameters_t& parameters, const RunOptions& options)
+{
+    constexpr tune_t rate = 10;
+    constexpr tune_t deviation_goal = 1e-6;
+    tune_t K = 2.5;
+    tune_t deviation = 1;
+    KernelParameters<tune_t> kernel_parameters;
+    kernel_parameters.exact_sigmoid = options.exact_sigmoid;
+    get_kernel_parameters(parameters, entries.get_dense_indices(), kernel_parameters);
+
+    while (fabs(deviation) > deviation_goal)
+    {
+        const auto slope = get_error_slope(thread_pool, entries, total_weight, kernel_parameters, K);
+        deviation = slope.k_derivative;
+        cout << "Current K: " << K << ", error: " << slope.error << ", deviation: " << deviation << endl;
+        K -= deviation * rate;
+    }
+
+    return K;
+}
+
+// Derivative of the error of an entry by its evaluation, split into the phases for tapered evaluations
+template<typename Scalar>
+struct GradientScale
+{
+#if TAPERED
+    Scalar midgame;
+    Scalar endgame;
+#else
+    Scalar value;
+#endif
+
+    template<typename Element>
+    void add_to(Element& gradient, const Scalar coefficient) const
+    {
+#if TAPERED
+        gradient[static_cast<int32_t>(PhaseStages::Midgame)] += midgame * coefficient;
+        gradient[static_cast<int32_t>(PhaseStages::Endgame)] += endgame * coefficient;
+#else
+        gradient += value * coefficient;
+#endif
+    }
+};
+
+// Scales of entries [first_entry, first_entry + count), count is at most sigmoid_block_size.
+// Their squared errors are added to error on the way, the sigmoids are already at hand.
+template<typename Scalar, typename Accumulator>
+static void get_gradient_scales(const BasicEntryList<Scalar>& entries, const size_t first_entry, const size_t count, const KernelParameters<Scalar>& params, const Scalar K, GradientScale<Scalar>* const scales, Accumulator& error)
+{
+    array<Scalar, sigmoid_block_size> evals;
+    array<Scalar, sigmoid_block_size> sigmoids;
+    get_block_sigmoids(entries, first_entry, count, params, K, evals, sigmoids);
+    for (size_t block_index = 0; block_index < count; block_index++)
+    {
+        const auto entry_index = first_entry + block_index;
+        const Scalar sig = sigmoids[block_index];
+        const Scalar diff = entries.get_wdls()[entry_index] - sig;
+        error += entries.get_weights()[entry_index] * diff * diff;
+        const Scalar res = entries.get_weights()[entry_index] * diff * sig * (1 - sig);
+#if TAPERED
+        scales[block_index] = {res * entries.get_midgame_weights()[entry_index], res * entries.get_endgame_weights()[entry_index]};
+#else
+        scales[block_index] = {res};
+#endif
+    }
+}
+
+template<typename Scalar, typename Accumulator>
+static void update_dense_gradient(basic_parameters_t<Accumulator>& dense_gradient, const BasicEntryList<Scalar>& entries, const size_t entry_index, const GradientScale<Scalar>& scale)
+{
+    const auto dense_coefficients = entries.get_dense_coefficients(entry_index);
+    for (size_t slot = 0; slot < dense_coefficients.size(); slot++)
+    {
+        scale.add_to(dense_gradient[slot], static_cast<Scalar>(dense_coefficients[slot]));
+    }
+}
+
+template<typename Scalar, typename Accumulator>
+static void update_single_gradient(basic_parameters_t<Accumulator>& gradient, basic_parameters_t<Accumulator>& dense_gradient, const BasicEntryList<Scalar>& entries, const size_t entry_index, const KernelParameters<Scalar>& params, const GradientScale<Scalar>& scale) {
+
+#if TAPERED
+    if constexpr (is_same_v<Scalar, double> && is_same_v<Accumulator, double>)
+    {
+        const auto coefficients = entries.get_encoded_coefficients(entry_index, entry_index + 1);
+        if (params.vector_kernels != nullptr)
+        {
+            params.vector_kernels->add_gradient(coefficients.data(), coefficients.data() + coefficients.size(), gradient.data(), {scale.midgame, scale.endgame});
+            update_dense_gradient(dense_gradient, entries, entry_index, scale);
+            return;
+        }
+    }
+#endif
+    entries.for_each_coefficient(entry_index, [&](const size_t index, const Scalar value)
+    {
+        scale.add_to(gradient[index], value);
+    });
+    update_dense_gradient(dense_gradient, entries, entry_index, scale);
+}
+
+// Entries of a chunk in update_gradient_tiled, enough that each tile gets a few coefficients of each cache line it covers
+constexpr size_t gradient_tile_entry_count = 8192;
+
+// Gradient of [first_entry, last_entry) for parameter sets too large for the per-thread gradient to stay in cache.
+// The scale of each entry of a chunk is computed once, then the coefficients of the whole chunk are accumulated
+// one tile of gradient_tile_parameter_count parameters at a time, so the part of the gradient being written stays cached.
+// Every gradient element still receives its terms in entry order, the result is the same as with update_single_gradient.
+template<typename Scalar, typename Accumulator>
+static void update_gradient_tiled(basic_parameters_t<Accumulator>& gradient, basic_parameters_t<Accumulator>& dense_gradient, const BasicEntryList<Scalar>& entries, const size_t first_entry, const size_t last_entry, const KernelParameters<Scalar>& params, const Scalar K, Accumulator& error)
+{
+    vector<GradientScale<Scalar>> scales(gradient_tile_entry_count);
+    vector<CoefficientCursor> cursors(gradient_tile_entry_count);
+    for (size_t chunk_start = first_entry; chunk_start < last_entry; chunk_start += gradient_tile_entry_count)
+    {
+        const auto chunk_size = min(gradient_tile_entry_count, last_entry - chunk_start);
+        for (size_t block_start = 0; block_start < chunk_size; block_start += sigmoid_block_size)
+        {
+            get_gradient_scales(entries, chunk_start + block_start, min(sigmoid_block_size, chunk_size - block_start), params, K, scales.data() + block_start, error);
+        }
+        for (size_t chunk_index = 0; chunk_index < chunk_size; chunk_index++)
+        {
+            const auto entry_index = chunk_start + chunk_index;
+            cursors[chunk_index] = entries.get_coefficient_cursor(entry_index);
+            update_dense_gradient(dense_gradient, entries, entry_index, scales[chunk_index]);
+        }
+
+        for (size_t tile_start = 0; tile_start < gradient.size(); tile_start += gradient_tile_parameter_count)
+        {
+            const auto tile_end = tile_start + gradient_tile_parameter_count;
+            for (size_t chunk_index = 0; chunk_index < chunk_size; chunk_index++)
+            {
+                const auto& scale = scales[chunk_index];
+                decode_coefficients_below<Scalar>(cursors[chunk_index], tile_end, [&](const size_t index, const Scalar value)
+                {
+                    scale.add_to(gradient[index], value);
+                });
+            }
+        }
+    }
+}
+
+// Calls function(parameter_index) for each parameter in [first, last) with its bit set in touched
+template<typename Function>
+static void for_each_touched_parameter(const vector<uint64_t>& touched, const size_t first, const size_t last, Function function)
+{
+    for (auto word_index = first / 64; word_index * 64 < last; word_index++)
+    {
+        const auto word_first = word_index * 64;
+        auto bits = touched[word_index];
+        if (word_first < first)
+        {
+            bits &= ~uint64_t(0) << (first - word_first);
+        }
+        if (last - word_first < 64)
+        {
+            bits &= (uint64_t(1) << (last - word_first)) - 1;
+        }
+
+        // Words with every parameter touched are a plain loop, so dense stretches cost no more than before
+        if (bits == ~uint64_t(0))
         {
-            entries.push_back(entry);
+            for (auto parameter_index = word_first; parameter_index < word_first + 64; parameter_index++)
+            {
+                function(parameter_index);
+            }
+            continue;
         }
-    }
-}
 
-static void load_fens(ThreadPool& thread_pool, const DataSource& source, const parameters_t& parameters, const high_resolution_clock::time_point start, vector<Entry>& entries)
-{
-    vector<string> fens;
-    read_fens(source, start, fens);
-    parse_fens(thread_pool, source, fens, parameters, start, entries);
+        while (bits != 0)
+        {
+            function(word_first + countr_zero(bits));
+            bits &= bits - 1;
+        }
+    }
 }
 
-static tune_t sigmoid(const tune_t K, const tune_t eval)
+// Gradients of an epoch as each thread accumulates them, before they are summed. They are kept from epoch to epoch,
+// so each thread allocates its own once and it stays on the NUMA node of that thread.
+template<typename Accumulator>
+struct PartialGradients
 {
-    return static_cast<tune_t>(1) / (static_cast<tune_t>(1) + exp(-K * eval / static_cast<tune_t>(400)));
-}
+    array<basic_parameters_t<Accumulator>, thread_count> sparse;
+    array<basic_parameters_t<Accumulator>, thread_count> dense;
+    array<tune_t, thread_count> errors{};
+    // One bit per parameter the entries of each thread have a sparse coefficient for. The other elements of its sparse
+    // partial are never written, so clearing and summing the partials only visit these.
+    array<vector<uint64_t>, thread_count> touched;
+    // Set once a whole epoch was accumulated, the entries of each thread stay the same from then on
+    bool touched_complete = false;
+    // Sums of the partials of the threads of each node, only used with more than one node
+    vector<parameters_t> node_sums;
+};
 
-static tune_t get_average_error(ThreadPool& thread_pool, const vector<Entry>& entries, const parameters_t& parameters, tune_t K)
+// Adds the gradient of the entries to the partial gradient of each thread and their squared error to its partial error,
+// both from the same pass. reset starts the partials over, for the first pass of an epoch.
+template<typename Scalar, typename Accumulator>
+static void compute_gradient(ThreadPool& thread_pool, PartialGradients<Accumulator>& partials, const BasicEntryList<Scalar>& entries, const KernelParameters<Scalar>& params, const tune_t K, const bool reset)
 {
-    array<tune_t, thread_count> thread_errors;
     for(int thread_id = 0; thread_id < thread_count; thread_id++)
     {
-        thread_pool.enqueue([thread_id, &thread_errors, &entries, &parameters, K]()
+        thread_pool.enqueue(thread_id, [thread_id, &partials, &entries, &params, K, reset]()
         {
-            const auto entries_per_thread = entries.size() / thread_count;
-            const auto start = static_cast<int>(thread_id * entries_per_thread);
-            const auto end = static_cast<int>((thread_id + 1) * entries_per_thread - 1);
-            tune_t error = 0;
-            for (int i = start; i < end; i++)
+            auto& gradient = partials.sparse[thread_id];
+            auto& dense_gradient = partials.dense[thread_id];
+            auto& touched = partials.touched[thread_id];
+            if (reset && partials.touched_complete)
+            {
+                for_each_touched_parameter(touched, 0, gradient.size(), [&](const size_t parameter_index)
+                {
+                    gradient[parameter_index] = {};
+                });
+                dense_gradient.assign(params.dense.size(), {});
+                partials.errors[thread_id] = 0;
+            }
+            else if (reset)
+            {
+                gradient.assign(params.sparse->size(), {});
+                dense_gradient.assign(params.dense.size(), {});
+                touched.assign((params.sparse->size() + 63) / 64, 0);
+                partials.errors[thread_id] = 0;
+            }
+
+            const auto [start, end] = get_thread_entry_range(entries.size(), thread_id);
+            if (!partials.touched_complete)
+            {
+                for (auto entry_index = start; entry_index < end; entry_index++)
+                {
+                    entries.for_each_coefficient(entry_index, [&](const size_t index, const Scalar)
+                    {
+                        touched[index / 64] |= uint64_t(1) << (index % 64);
+                    });
+                }
+            }
+            Accumulator error{};
+            const auto tile_count = (gradient.size() + gradient_tile_parameter_count - 1) / gradient_tile_parameter_count;
+            if (tile_count > 1 && tile_count <= gradient_max_tile_count)
+            {
+                update_gradient_tiled<Scalar, Accumulator>(gradient, dense_gradient, entries, start, end, params, static_cast<Scalar>(K), error);
+            }
+            else
             {
-                const auto& entry = entries[i];
-                const auto eval = linear_eval(entry, parameters);
-                const auto sig = sigmoid(K, eval);
-                const auto diff = entry.wdl - sig;
-                const auto entry_error = pow(diff, 2);
-                error += entry_error;
+                array<GradientScale<Scalar>, sigmoid_block_size> scales;
+                for (size_t block_start = start; block_start < end; block_start += sigmoid_block_size)
+                {
+                    const auto block_size = min(sigmoid_block_size, end - block_start);
+                    get_gradient_scales(entries, block_start, block_size, params, static_cast<Scalar>(K), scales.data(), error);
+                    for (size_t block_index = 0; block_index < block_size; block_index++)
+                    {
+                        update_single_gradient<Scalar, Accumulator>(gradient, dense_gradient, entries, block_start + block_index, params, scales[block_index]);
+                    }
+                }
             }
-            thread_errors[thread_id] = error;
+            partials.errors[thread_id] += static_cast<tune_t>(error);
         });
     }
 
     thread_pool.wait_for_completion();
+}
 
-    tune_t total_error = 0;
-    for (int thread_id = 0; thread_id < thread_count; thread_id++)
+template<typename Scalar, typename Accumulator>
+static void compute_gradient(ThreadPool& thread_pool, PartialGradients<Accumulator>& partials, EntryShards& shards, const KernelParameters<Scalar>& params, const tune_t K, const bool reset)
+{
+    static_assert(is_same_v<Scalar, tune_t>, "Shards are stored in tune_t");
+    auto reset_partials = reset;
+    shards.for_each_shard([&](const EntryList& shard)
     {
-        total_error += thread_errors[thread_id];
-    }
-
-    const tune_t avg_error = total_error / static_cast<tune_t>(entries.size());
-    return avg_error;
+        compute_gradient<Scalar, Accumulator>(thread_pool, partials, shard, params, K, reset_partials);
+        reset_partials = false;
+    });
 }
 
-static tune_t find_optimal_k(ThreadPool& thread_pool, const vector<Entry>& entries, const parameters_t& parameters)
+template<typename Element>
+static void add_gradient_element(parameters_t::value_type& target, const Element& value)
 {
-    constexpr tune_t rate = 10;
-    constexpr tune_t delta = 1e-5;
-    constexpr tune_t deviation_goal = 1e-6;
-    tune_t K = 2.5;
-    tune_t deviation = 1;
+#if TAPERED
+    target[static_cast<int32_t>(PhaseStages::Midgame)] += static_cast<tune_t>(value[static_cast<int32_t>(PhaseStages::Midgame)]);
+    target[static_cast<int32_t>(PhaseStages::Endgame)] += static_cast<tune_t>(value[static_cast<int32_t>(PhaseStages::Endgame)]);
+#else
+    target += static_cast<tune_t>(value);
+#endif
+}
 
-    while (fabs(deviation) > deviation_goal)
+// Adds parameters [first, last) of the partial gradient of a thread to target, which starts at parameter first.
+// Only the parameters the thread touched are read from its sparse partial.
+template<typename Accumulator>
+static void add_partial_gradient(parameters_t::value_type* const target, const PartialGradients<Accumulator>& partials, const int thread_id, const span<const uint32_t> dense_indices, const size_t first, const size_t last)
+{
+    for (size_t slot = 0; slot < dense_indices.size(); slot++)
     {
-        const tune_t up = get_average_error(thread_pool, entries, parameters, K + delta);
-        const tune_t down = get_average_error(thread_pool, entries, parameters, K - delta);
-        deviation = (up - down) / (2 * delta);
-        cout << "Current K: " << K << ", up: " << up << ", down: " << down << ", deviation: " << deviation << endl;
-        K -= deviation * rate;
+        if (dense_indices[slot] >= first && dense_indices[slot] < last)
+        {
+            add_gradient_element(target[dense_indices[slot] - first], partials.dense[thread_id][slot]);
+        }
     }
 
-    return K;
+    const auto& gradient = partials.sparse[thread_id];
+    for_each_touched_parameter(partials.touched[thread_id], first, last, [&](const size_t parameter_index)
+    {
+        add_gradient_element(target[parameter_index - first], gradient[parameter_index]);
+    });
 }
 
-static void update_single_gradient(parameters_t& gradient, const Entry& entry, const parameters_t& params, tune_t K) {
-
-    const tune_t eval = linear_eval(entry, params);
-    const tune_t sig = sigmoid(K, eval);
-    const tune_t res = (entry.wdl - sig) * sig * (1 - sig);
+static void adam_step(tune_t& parameter, tune_t& momentum, tune_t& velocity, const tune_t gradient, const tune_t K, const tune_t total_weight, const tune_t learning_rate)
+{
+    constexpr tune_t beta1 = 0.9;
+    constexpr tune_t beta2 = 0.999;
 
-#if TAPERED
-    const auto mg_base = res * (entry.phase / static_cast<tune_t>(24));
-    const auto eg_base = res - mg_base;
-#endif
+    const tune_t grad = -K / static_cast<tune_t>(400) * gradient / total_weight;
+    momentum = beta1 * momentum + (1 - beta1) * grad;
+    velocity = beta2 * velocity + (1 - beta2) * (grad * grad);
+    parameter -= learning_rate * momentum / (static_cast<tune_t>(1e-8) + sqrt(velocity));
+}
 
-    for (const auto& coefficient : entry.coefficients)
+// Sums the partial gradients and applies the Adam step. Every thread does both for its own range of parameters,
+// so the only serial work left is adding up the partial errors. With several NUMA nodes the threads of each node first
+// sum the partials of that node, split the same way among them, and only the node sums are read across nodes.
+// Returns the summed error of the epoch.
+template<typename Accumulator>
+static tune_t apply_gradient(ThreadPool& thread_pool, PartialGradients<Accumulator>& partials, const span<const uint32_t> dense_indices, parameters_t& parameters, parameters_t& momentum, parameters_t& velocity, const tune_t K, const tune_t total_weight, const tune_t learning_rate)
+{
+    const auto parameter_count = parameters.size();
+    const auto node_count = thread_pool.node_count();
+    if (node_count > 1)
     {
-#if TAPERED
-        gradient[coefficient.index][static_cast<int32_t>(PhaseStages::Midgame)] += mg_base * coefficient.value;
-        gradient[coefficient.index][static_cast<int32_t>(PhaseStages::Endgame)] += eg_base * coefficient.value * entry.endgame_scale;
-#else
-        gradient[coefficient.index] += res * coefficient.value;
-#endif
+        vector<int> first_node_threads(node_count + 1, thread_count);
+        for (int thread_id = thread_count - 1; thread_id >= 0; thread_id--)
+        {
+            first_node_threads[thread_pool.get_thread_node(thread_id)] = thread_id;
+        }
+
+        // Each node sum is allocated by a thread of its node, so it is placed there
+        if (partials.node_sums.size() != node_count)
+        {
+            partials.node_sums.resize(node_count);
+            for (uint32_t node = 0; node < node_count; node++)
+            {
+                thread_pool.enqueue(first_node_threads[node], [node, &partials, parameter_count]()
+                {
+                    partials.node_sums[node].resize(parameter_count);
+                });
+            }
+            thread_pool.wait_for_completion();
+        }
+
+        for (int thread_id = 0; thread_id < thread_count; thread_id++)
+        {
+            thread_pool.enqueue(thread_id, [thread_id, &thread_pool, &partials, &first_node_threads, dense_indices, parameter_count]()
+            {
+                const auto node = thread_pool.get_thread_node(thread_id);
+                const auto first_thread = first_node_threads[node];
+                const auto last_thread = first_node_threads[node + 1];
+                const auto [first, last] = get_part_range(parameter_count, thread_id - first_thread, last_thread - first_thread);
+                auto* const node_sum = partials.node_sums[node].data() + first;
+                fill(node_sum, node_sum + (last - first), parameters_t::value_type{});
+                for (auto node_thread = first_thread; node_thread < last_thread; node_thread++)
+                {
+                    add_partial_gradient(node_sum, partials, node_thread, dense_indices, first, last);
+                }
+            });
+        }
+        thread_pool.wait_for_completion();
     }
-}
 
-static void compute_gradient(ThreadPool& thread_pool, parameters_t& gradient, const vector<Entry>& entries, const parameters_t& params, tune_t K)
-{
-    array<parameters_t, thread_count> thread_gradients;
-    for(int thread_id = 0; thread_id < thread_count; thread_id++)
+    for (int thread_id = 0; thread_id < thread_count; thread_id++)
     {
-        thread_pool.enqueue([thread_id, &thread_gradients, &entries, &params, K]()
+        thread_pool.enqueue(thread_id, [thread_id, &partials, &parameters, &momentum, &velocity, dense_indices, parameter_count, node_count, K, total_weight, learning_rate]()
         {
-            const auto entries_per_thread = entries.size() / thread_count;
-            const auto start = static_cast<int>(thread_id * entries_per_thread);
-            const auto end = static_cast<int>((thread_id + 1) * entries_per_thread - 1);
+            const auto [first, last] = get_part_range(parameter_count, thread_id, thread_count);
+            parameters_t gradient(last - first);
+            if (node_count > 1)
+            {
+                for (const auto& node_sum : partials.node_sums)
+                {
+                    for (size_t parameter_index = first; parameter_index < last; parameter_index++)
+                    {
+                        add_gradient_element(gradient[parameter_index - first], node_sum[parameter_index]);
+                    }
+                }
+            }
+            else
+            {
+                for (int partial_thread = 0; partial_thread < thread_count; partial_thread++)
+                {
+                    add_partial_gradient(gradient.data(), partials, partial_thread, dense_indices, first, last);
+                }
+            }
+
+            for (size_t parameter_index = first; parameter_index < last; parameter_index++)
+            {
 #if TAPERED
-            parameters_t gradient = parameters_t(params.size(), pair_t{});
+                for (int phase_stage = 0; phase_stage < 2; phase_stage++)
+                {
+                    adam_step(parameters[parameter_index][phase_stage], momentum[parameter_index][phase_stage], velocity[parameter_index][phase_stage], gradient[parameter_index - first][phase_stage], K, total_weight, learning_rate);
+                }
 #else
-            parameters_t gradient = parameters_t(params.size(), 0);
+                adam_step(parameters[parameter_index], momentum[parameter_index], velocity[parameter_index], gradient[parameter_index - first], K, total_weight, learning_rate);
 #endif
-            for (int i = start; i < end; i++)
-            {
-                const auto& entry = entries[i];
-                update_single_gradient(gradient, entry, params, K);
             }
-            thread_gradients[thread_id] = gradient;
         });
     }
-
     thread_pool.wait_for_completion();
 
+    tune_t error = 0;
     for (int thread_id = 0; thread_id < thread_count; thread_id++)
     {
-        for(auto parameter_index = 0; parameter_index < params.size(); parameter_index++)
-        {
-#if TAPERED
-            gradient[parameter_index][static_cast<int32_t>(PhaseStages::Midgame)] += thread_gradients[thread_id][parameter_index][static_cast<int32_t>(PhaseStages::Midgame)];
-            gradient[parameter_index][static_cast<int32_t>(PhaseStages::Endgame)] += thread_gradients[thread_id][parameter_index][static_cast<int32_t>(PhaseStages::Endgame)];
-#else
-            gradient[parameter_index] += thread_gradients[thread_id][parameter_index];
-#endif
-        }
+        error += partials.errors[thread_id];
     }
+    return error;
 }
 
-void Tuner::run(const std::vector<DataSource>& sources)
+// The epoch loop with the entries in the kernel precision, parameters, gradients and the Adam state stay in tune_t.
+// Entries is an entry list in memory or the shards of an out-of-core run.
+template<typename Scalar, typename Accumulator, typename Entries>
+static void tune_parameters(ThreadPool& thread_pool, Entries& entries, const tune_t total_weight, parameters_t& parameters, const vector<uint32_t>& original_indices, const tune_t K, const RunOptions& options, const high_resolution_clock::time_point start)
 {
-    cout << "Starting tuning" << endl << endl;
-    const auto start = high_resolution_clock::now();
-
-    cout << "Starting thread pool..." << endl;
-    ThreadPool thread_pool;
-    thread_pool.start(thread_count);
-
-    cout << "Getting initial parameters..." << endl;
-    auto parameters = TuneEval::get_initial_parameters();
-    cout << "Got " << parameters.size() << " parameters" << endl;
+    const auto loop_start = high_resolution_clock::now();
+    tune_t learning_rate = TuneEval::initial_learning_rate;
+    int32_t max_tune_epoch = TuneEval::max_epoch;
+#if TAPERED
+    parameters_t momentum(parameters.size(), pair_t{});
+    parameters_t velocity(parameters.size(), pair_t{});
+#else
+    parameters_t momentum(parameters.size(), 0);
+    parameters_t velocity(parameters.size(), 0);
+#endif
+    KernelParameters<Scalar> kernel_parameters;
+    kernel_parameters.exact_sigmoid = options.exact_sigmoid;
+    PartialGradients<Accumulator> partials;
+    for (int32_t epoch = 1; epoch < max_tune_epoch; epoch++)
+    {
+        compute_gradient<Scalar, Accumulator>(thread_pool, partials, entries, get_kernel_parameters(parameters, entries.get_dense_indices(), kernel_parameters), K, true);
+        partials.touched_complete = true;
 
-    cout << "Initial parameters:" << endl;
-    TuneEval::print_parameters(parameters);
+        // The error of the parameters this epoch starts from, it comes with the gradient at no extra cost
+        const tune_t error = apply_gradient(thread_pool, partials, entries.get_dense_indices(), parameters, momentum, velocity, K, total_weight, learning_rate) / total_weight;
+        if (epoch == 1)
+        {
+            cout << "Initial error = " << error << endl;
+        }
 
-    vector<Entry> entries;
+        if (epoch % 100 == 0)
+        {
+            const auto elapsed_ms = duration_cast<milliseconds>(high_resolution_clock::now() - loop_start).count();
+            const auto epochs_per_second = epoch * 1000.0 / elapsed_ms;
+            print_elapsed(start);
+            cout << "Epoch " << epoch << " (" << epochs_per_second << " eps), error " << error << ", LR " << learning_rate << endl;
+            if constexpr (is_same_v<Entries, EntryShards>)
+            {
+                entries.print_throughput();
+            }
+            print_parameters(parameters, original_indices);
+        }
+        else if (epoch > 1 && epoch % error_print_interval == 0)
+        {
+            cout << "Epoch " << epoch << ", error " << error << endl;
+        }
 
-    // Debug entry
-    //const string debug_fen = "rnb1kbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQK1NR w KQkq - 0 1; 1.0";
-    //Entry debug_entry;
-    //debug_entry.wdl = get_fen_wdl(debug_fen);
-    //debug_entry.white_to_move = get_fen_color_to_move(debug_fen);
-    //get_coefficient_entries(debug_fen, debug_entry.coefficients);
-    //debug_entry.initial_eval = linear_eval(debug_entry, parameters);
-    //entries.push_back(debug_entry);
+        if(epoch % TuneEval::learning_rate_drop_interval == 0)
+        {
+            learning_rate *= TuneEval::learning_rate_drop_ratio;
+        }
+    }
+}
 
-    vector<string> fens;
-    for (const auto& source : sources)
+// Copies source into target with every thread copying the range of entries it evaluates in the kernels,
+// so with pinned threads each range is first written by, and placed on the NUMA node of, the thread that reads it
+template<typename Scalar, typename OtherScalar>
+static void place_entries(ThreadPool& thread_pool, const BasicEntryList<OtherScalar>& source, BasicEntryList<Scalar>& target)
+{
+    target.allocate_like(source);
+    for (int thread_id = 0; thread_id < thread_count; thread_id++)
     {
-        load_fens(thread_pool, source, parameters, start, entries);
+        const auto [first_entry, last_entry] = get_thread_entry_range(source.size(), thread_id);
+        thread_pool.enqueue(thread_id, [&source, &target, first_entry, last_entry]()
+        {
+            target.copy_range(source, first_entry, last_entry);
+        });
     }
-    cout << "Data loading complete" << endl << endl;
+    thread_pool.wait_for_completion();
+}
 
-    print_statistics(parameters, entries);
+// K is searched for and the initial error is measured in full precision, only the epochs run in the kernel precision
+template<typename Scalar, typename Accumulator>
+static void tune_in_kernel_precision(ThreadPool& thread_pool, EntryList& entries, const tune_t total_weight, parameters_t& parameters, const vector<uint32_t>& original_indices, const tune_t K, const RunOptions& options, const high_resolution_clock::time_point start)
+{
+    if constexpr (is_same_v<Scalar, tune_t>)
+    {
+        tune_parameters<Scalar, Accumulator>(thread_pool, entries, total_weight, parameters, original_indices, K, options, start);
+    }
+    else
+    {
+        BasicEntryList<Scalar> kernel_entries;
+        place_entries(thread_pool, entries, kernel_entries);
+        entries = EntryList();
+        tune_parameters<Scalar, Accumulator>(thread_pool, kernel_entries, total_weight, parameters, original_indices, K, options, start);
+    }
+}
 
+// Finds K and runs the epochs on the loaded entries, in memory or streamed from shards
+template<typename Entries>
+static void tune_entries(ThreadPool& thread_pool, Entries& entries, const tune_t total_weight, parameters_t& parameters, const vector<uint32_t>& original_indices, const RunOptions& options, const high_resolution_clock::time_point start)
+{
     if constexpr (TuneEval::retune_from_zero)
     {
         for (auto& parameter : parameters)
@@ -860,13 +2330,13 @@ void Tuner::run(const std::vector<DataSource>& sources)
     }
 
     cout << "Initial parameters:" << endl;
-    TuneEval::print_parameters(parameters);
+    print_parameters(parameters, original_indices);
 
     tune_t K;
     if constexpr (TuneEval::preferred_k <= 0)
     {
         cout << "Finding optimal K..." << endl;
-        K = find_optimal_k(thread_pool, entries, parameters);
+        K = find_optimal_k(thread_pool, entries, total_weight, parameters, options);
     }
     else
     {
@@ -875,65 +2345,126 @@ void Tuner::run(const std::vector<DataSource>& sources)
     }
     cout << "K = " << K << endl;
 
-    const auto avg_error = get_average_error(thread_pool, entries, parameters, K);
-    cout << "Initial error = " << avg_error << endl;
+    if constexpr (is_same_v<Entries, EntryShards>)
+    {
+        tune_parameters<tune_t, tune_t>(thread_pool, entries, total_weight, parameters, original_indices, K, options, start);
+    }
+    else if (options.float_kernels)
+    {
+        using float_accumulator_t = conditional_t<compensated_kernel_sums, CompensatedSum<float>, tune_t>;
+        tune_in_kernel_precision<float, float_accumulator_t>(thread_pool, entries, total_weight, parameters, original_indices, K, options, start);
+    }
+    else
+    {
+        tune_in_kernel_precision<tune_t, tune_t>(thread_pool, entries, total_weight, parameters, original_indices, K, options, start);
+    }
+}
 
-    const auto loop_start = high_resolution_clock::now();
-    tune_t learning_rate = TuneEval::initial_learning_rate;
-    int32_t max_tune_epoch = TuneEval::max_epoch;
-#if TAPERED
-    parameters_t momentum(parameters.size(), pair_t{});
-    parameters_t velocity(parameters.size(), pair_t{});
-#else
-    parameters_t momentum(parameters.size(), 0);
-    parameters_t velocity(parameters.size(), 0);
-#endif
-    for (int32_t epoch = 1; epoch < max_tune_epoch; epoch++)
+// Writes the entries to the shards while they are parsed, memory then only holds the ranges being parsed, the entries
+// parsed ahead of them and the shard being filled. The sources are loaded one at a time and each is written in file order.
+static void load_sources_into_shards(ThreadPool& thread_pool, const vector<DataSource>& sources, const parameters_t& parameters, const high_resolution_clock::time_point start, EntryShards& shards)
+{
+    EntryList entries;
+    for (const auto& source : sources)
     {
-#if TAPERED
-        parameters_t gradient(parameters.size(), pair_t{});
-#else
-        parameters_t gradient(parameters.size(), 0);
-#endif
-        
-        compute_gradient(thread_pool, gradient, entries, parameters, K);
+        load_sources(thread_pool, {source}, parameters, start, entries, &shards);
+    }
+    shards.finish();
 
-        constexpr tune_t beta1 = 0.9;
-        constexpr tune_t beta2 = 0.999;
+    print_elapsed(start);
+    cout << "Wrote " << shards.size() << " entries to " << shards.shard_count() << " shards in " << entry_shard_directory << endl;
+}
 
-        for (int parameter_index = 0; parameter_index < parameters.size(); parameter_index++) {
-#if TAPERED
-            for(int phase_stage = 0; phase_stage < 2; phase_stage++)
-            {
-                const tune_t grad = -K / static_cast<tune_t>(400) * gradient[parameter_index][phase_stage] / static_cast<tune_t>(entries.size());
-                momentum[parameter_index][phase_stage] = beta1 * momentum[parameter_index][phase_stage] + (1 - beta1) * grad;
-                velocity[parameter_index][phase_stage] = beta2 * velocity[parameter_index][phase_stage] + (1 - beta2) * pow(grad, 2);
-                parameters[parameter_index][phase_stage] -= learning_rate * momentum[parameter_index][phase_stage] / (static_cast<tune_t>(1e-8) + sqrt(velocity[parameter_index][phase_stage]));
-            }
-#else
-            const tune_t grad = -K / 400.0 * gradient[parameter_index] / static_cast<tune_t>(entries.size());
-            momentum[parameter_index] = beta1 * momentum[parameter_index] + (1 - beta1) * grad;
-            velocity[parameter_index] = beta2 * velocity[parameter_index] + (1 - beta2) * pow(grad, 2);
-            parameters[parameter_index] -= learning_rate * momentum[parameter_index] / (1e-8 + sqrt(velocity[parameter_index]));
-#endif
-            
-        }
+void Tuner::run(const std::vector<DataSource>& sources, const RunOptions& options)
+{
+    cout << "Starting tuning" << endl << endl;
+    const auto start = high_resolution_clock::now();
 
-        if (epoch % 100 == 0)
-        {
-            const auto elapsed_ms = duration_cast<milliseconds>(high_resolution_clock::now() - loop_start).count();
-            const auto epochs_per_second = epoch * 1000.0 / elapsed_ms;
-            const tune_t error = get_average_error(thread_pool, entries, parameters, K);
-            print_elapsed(start);
-            cout << "Epoch " << epoch << " (" << epochs_per_second << " eps), error " << error << ", LR " << learning_rate << endl;
-            TuneEval::print_parameters(parameters);
-        }
+    cout << "Starting thread pool..." << endl;
+    ThreadPool thread_pool;
+    thread_pool.start(thread_count, pin_threads);
+    if constexpr (pin_threads)
+    {
+        cout << "Pinned " << thread_count << " threads over " << thread_pool.node_count() << " NUMA nodes" << endl;
+    }
+    if (options.float_kernels)
+    {
+        cout << (out_of_core_memory_limit > 0 ? "Out-of-core tuning runs the epochs in tune_t, ignoring --float-kernels" : "Using float kernels") << endl;
+    }
+    else if constexpr (TAPERED)
+    {
+        const auto* vector_kernels = get_vector_kernels(max_kernel_isa);
+        cout << "Using " << get_kernel_isa_name(vector_kernels != nullptr ? vector_kernels->isa : KernelIsa::Scalar) << " kernels" << endl;
+    }
 
-        if(epoch % TuneEval::learning_rate_drop_interval == 0)
+    if (options.exact_sigmoid)
+    {
+        cout << "Using the exact sigmoid" << endl;
+    }
+    else
+    {
+        check_fast_sigmoid<tune_t>();
+        if (options.float_kernels && !is_same_v<float, tune_t>)
         {
-            learning_rate *= TuneEval::learning_rate_drop_ratio;
+            check_fast_sigmoid<float>();
         }
     }
 
+    cout << "Getting initial parameters..." << endl;
+    auto parameters = TuneEval::get_initial_parameters();
+    cout << "Got " << parameters.size() << " parameters" << endl;
+
+    cout << "Initial parameters:" << endl;
+    TuneEval::print_parameters(parameters);
+
+    if constexpr (out_of_core_memory_limit > 0)
+    {
+        static_assert(!enable_deduplication && !enable_parameter_reordering, "Out-of-core tuning supports neither deduplication nor parameter reordering");
+        EntryShards shards(entry_shard_directory, out_of_core_memory_limit);
+        load_sources_into_shards(thread_pool, sources, parameters, start, shards);
+        cout << "Data loading complete" << endl << endl;
+        tune_entries(thread_pool, shards, shards.get_total_weight(), parameters, {}, options, start);
+        thread_pool.stop();
+        return;
+    }
+
+    EntryList entries;
+
+    // Debug entry
+    //const string debug_fen = "rnb1kbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQK1NR w KQkq - 0 1; 1.0";
+    //Entry debug_entry;
+    //debug_entry.wdl = get_fen_wdl(debug_fen);
+    //debug_entry.white_to_move = get_fen_color_to_move(debug_fen);
+    //get_coefficient_entries(debug_fen, debug_entry.coefficients);
+    //debug_entry.initial_eval = linear_eval(debug_entry, parameters);
+    //entries.push_back(debug_entry);
+
+    load_sources(thread_pool, sources, parameters, start, entries);
+    cout << "Data loading complete" << endl << endl;
+
+    if constexpr (enable_deduplication)
+    {
+        const auto loaded_count = entries.size();
+        const auto collapsed_count = deduplicate_entries(thread_pool, entries);
+        print_elapsed(start);
+        cout << "Deduplicated " << loaded_count << " entries, collapsed " << collapsed_count << " duplicates into " << entries.size() << " unique positions" << endl << endl;
+    }
+    const auto total_weight = get_total_weight(entries);
+
+    print_statistics(parameters, entries);
+    promote_dense_coefficients(entries, parameters.size());
+    vector<uint32_t> original_indices;
+    if constexpr (enable_parameter_reordering)
+    {
+        original_indices = reorder_parameters(entries, parameters);
+    }
+    if (thread_pool.node_count() > 1)
+    {
+        EntryList placed_entries;
+        place_entries(thread_pool, entries, placed_entries);
+        entries = std::move(placed_entries);
+    }
+
+    tune_entries(thread_pool, entries, total_weight, parameters, original_indices, options, start);
     thread_pool.stop();
 }
@@ -7,14 +7,34 @@
 
 namespace Tuner
 {
+    enum class DataFormat
+    {
+        Epd,
+        Pgn,
+        Marlin,
+        Bullet
+    };
+
     struct DataSource
     {
         std::string path;
         bool side_to_move_wdl;
         int64_t position_limit;
+        DataFormat format = DataFormat::Epd;
+    };
+
+    // Settings chosen on the command line
+    struct RunOptions
+    {
+        // Evaluates the sigmoid with exp instead of the vectorized approximation, to confirm the approximation
+        // does not change the result
+        bool exact_sigmoid = false;
+        // Runs the epochs with the entries stored and evaluated in float, which halves their memory traffic.
+        // The parameters and the optimizer state stay in tune_t.
+        bool float_kernels = false;
     };
 
-    void run(const std::vector<DataSource>& sources);
+    void run(const std::vector<DataSource>& sources, const RunOptions& options);
 }
 
 #endif // !TUNER_H
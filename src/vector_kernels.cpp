@@ -0,0 +1,387 @@
+#include "vector_kernels.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define VECTOR_KERNELS_X86 1
+// The AVX-512 intrinsics of some GCC versions start from self-initialized undefined vectors, which trips these warnings
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+
+// Each instruction set's kernels are compiled for it here regardless of the build flags, and only called once the
+// processor is known to support it. MSVC needs no attribute to emit any instruction set.
+#if defined(__GNUC__)
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+#else
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+using namespace std;
+
+#if VECTOR_KERNELS_X86
+
+static KernelIsa get_supported_isa()
+{
+#if defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        return KernelIsa::Avx512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        return KernelIsa::Avx2;
+    }
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuidex(info, 0, 0);
+    if (info[0] < 7)
+    {
+        return KernelIsa::Scalar;
+    }
+
+    // The operating system has to save the vector registers on context switches too
+    __cpuidex(info, 1, 0);
+    const bool has_fma = (info[2] & (1 << 12)) != 0;
+    const bool has_xsave = (info[2] & (1 << 27)) != 0;
+    if (!has_fma || !has_xsave)
+    {
+        return KernelIsa::Scalar;
+    }
+    const auto saved_state = _xgetbv(0);
+
+    __cpuidex(info, 7, 0);
+    const bool has_avx2 = (info[1] & (1 << 5)) != 0;
+    const bool has_avx512 = (info[1] & (1 << 16)) != 0;
+    if (has_avx512 && (saved_state & 0xE6) == 0xE6)
+    {
+        return KernelIsa::Avx512;
+    }
+    if (has_avx2 && (saved_state & 0x6) == 0x6)
+    {
+        return KernelIsa::Avx2;
+    }
+#endif
+    return KernelIsa::Scalar;
+}
+
+// Parameter pairs of two coefficients in the low and high half
+TARGET_AVX2 static inline __m256d load_pairs(const array<double, 2>* pairs, const size_t first_index, const size_t second_index)
+{
+    return _mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_loadu_pd(pairs[first_index].data())), _mm_loadu_pd(pairs[second_index].data()), 1);
+}
+
+// Values of two coefficients, each repeated for both phases
+TARGET_AVX2 static inline __m256d load_values(const CoefficientWord first_word, const CoefficientWord second_word)
+{
+    const auto* values = coefficient_values<double>;
+    return _mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_loaddup_pd(&values[first_word & coefficient_value_mask])), _mm_loaddup_pd(&values[second_word & coefficient_value_mask]), 1);
+}
+
+// True when none of the four words at cursor starts an escaped coefficient.
+// Adding 0x7FFF to a code of 1..15 sets bit 15 of its word without carrying into the next one, a code of 0 leaves it clear.
+static inline bool are_compact_words(const CoefficientWord* const cursor)
+{
+    uint64_t words;
+    memcpy(&words, cursor, sizeof(words));
+    constexpr uint64_t code_mask = 0x000F000F000F000Full;
+    constexpr uint64_t high_bits = 0x8000800080008000ull;
+    return (((words & code_mask) + 0x7FFF7FFF7FFF7FFFull) & high_bits) == high_bits;
+}
+
+// One coefficient decoded scalar, compact or escaped, returns the position past its words
+TARGET_AVX2 static inline const CoefficientWord* evaluate_single(const CoefficientWord* cursor, size_t& index, const array<double, 2>* parameters, __m128d& pair_sum)
+{
+    double value;
+    cursor = decode_coefficient(cursor, index, value);
+    pair_sum = _mm_fmadd_pd(_mm_loadu_pd(parameters[index].data()), _mm_set1_pd(value), pair_sum);
+    return cursor;
+}
+
+// Two coefficients per 256-bit vector, with two accumulators so consecutive FMAs do not wait on each other.
+// AVX2 gathers are no faster than the two 128-bit loads per vector on most processors, so the indices are decoded scalar.
+// Blocks of four words containing an escape are stepped through one coefficient at a time until the escape is passed.
+TARGET_AVX2 static void evaluate_avx2(const CoefficientWord* cursor, const CoefficientWord* const end, const array<double, 2>* parameters, array<double, 2>& sums)
+{
+    __m256d first_sum = _mm256_setzero_pd();
+    __m256d second_sum = _mm256_setzero_pd();
+    __m128d escaped_sum = _mm_setzero_pd();
+    size_t index = 0;
+    while (cursor + 4 <= end)
+    {
+        if (!are_compact_words(cursor)) [[unlikely]]
+        {
+            cursor = evaluate_single(cursor, index, parameters, escaped_sum);
+            continue;
+        }
+
+        const auto index0 = index + (cursor[0] >> 4);
+        const auto index1 = index0 + (cursor[1] >> 4);
+        const auto index2 = index1 + (cursor[2] >> 4);
+        index = index2 + (cursor[3] >> 4);
+        first_sum = _mm256_fmadd_pd(load_pairs(parameters, index0, index1), load_values(cursor[0], cursor[1]), first_sum);
+        second_sum = _mm256_fmadd_pd(load_pairs(parameters, index2, index), load_values(cursor[2], cursor[3]), second_sum);
+        cursor += 4;
+    }
+
+    const auto sum = _mm256_add_pd(first_sum, second_sum);
+    auto pair_sum = _mm_add_pd(_mm_add_pd(_mm256_castpd256_pd128(sum), _mm256_extractf128_pd(sum, 1)), escaped_sum);
+    while (cursor < end)
+    {
+        cursor = evaluate_single(cursor, index, parameters, pair_sum);
+    }
+    _mm_storeu_pd(sums.data(), _mm_add_pd(_mm_loadu_pd(sums.data()), pair_sum));
+}
+
+TARGET_AVX2 static void add_gradient_avx2(const CoefficientWord* cursor, const CoefficientWord* const end, array<double, 2>* gradient, const array<double, 2>& scale)
+{
+    const auto scale_pair = _mm_loadu_pd(scale.data());
+    size_t index = 0;
+    while (cursor < end)
+    {
+        double value;
+        cursor = decode_coefficient(cursor, index, value);
+        auto* element = gradient[index].data();
+        _mm_storeu_pd(element, _mm_fmadd_pd(scale_pair, _mm_set1_pd(value), _mm_loadu_pd(element)));
+    }
+}
+
+// Eight coefficients decoded in vector registers, split into two halves of four coefficients with one lane per phase
+struct Avx512Block
+{
+    // Offsets in doubles of each lane's parameter element
+    __m512i first_offsets;
+    __m512i second_offsets;
+    __m512d first_values;
+    __m512d second_values;
+};
+
+// Decodes eight words, index holds the index of the last coefficient before them in every lane and is advanced past them
+TARGET_AVX512 static inline Avx512Block decode_block(const __m128i packed_words, __m512i& index)
+{
+    const auto words = _mm512_cvtepu16_epi64(packed_words);
+    const auto zero = _mm512_setzero_si512();
+
+    // Prefix sum of the index distances, shifting in zeros from the lower lanes
+    auto indices = _mm512_srli_epi64(words, 4);
+    indices = _mm512_add_epi64(indices, _mm512_alignr_epi64(indices, zero, 7));
+    indices = _mm512_add_epi64(indices, _mm512_alignr_epi64(indices, zero, 6));
+    indices = _mm512_add_epi64(indices, _mm512_alignr_epi64(indices, zero, 4));
+    indices = _mm512_add_epi64(indices, index);
+    index = _mm512_permutexvar_epi64(_mm512_set1_epi64(7), indices);
+
+    const auto first_lanes = _mm512_set_epi64(3, 3, 2, 2, 1, 1, 0, 0);
+    const auto second_lanes = _mm512_set_epi64(7, 7, 6, 6, 5, 5, 4, 4);
+    const auto phases = _mm512_set_epi64(1, 0, 1, 0, 1, 0, 1, 0);
+    const auto offsets = _mm512_slli_epi64(indices, 1);
+
+    // The sixteen coefficient values fit in two registers, indexed by the code
+    const auto* values = coefficient_values<double>;
+    const auto low_values = _mm512_loadu_pd(values);
+    const auto high_values = _mm512_loadu_pd(values + 8);
+    const auto codes = _mm512_and_si512(words, _mm512_set1_epi64(coefficient_value_mask));
+
+    return Avx512Block
+    {
+        _mm512_add_epi64(_mm512_permutexvar_epi64(first_lanes, offsets), phases),
+        _mm512_add_epi64(_mm512_permutexvar_epi64(second_lanes, offsets), phases),
+        _mm512_permutex2var_pd(low_values, _mm512_permutexvar_epi64(first_lanes, codes), high_values),
+        _mm512_permutex2var_pd(low_values, _mm512_permutexvar_epi64(second_lanes, codes), high_values)
+    };
+}
+
+// Whether any of the first count words starts an escaped coefficient
+TARGET_AVX512 static inline bool has_escaped_words(const __m128i packed_words, const size_t count)
+{
+    const auto codes = _mm_and_si128(packed_words, _mm_set1_epi16(static_cast<short>(coefficient_value_mask)));
+    const auto escapes = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi16(codes, _mm_setzero_si128())));
+    return (escapes & ((1u << (2 * count)) - 1)) != 0;
+}
+
+// One coefficient decoded scalar, for the words around an escape. index holds the index of the last coefficient in every lane.
+TARGET_AVX512 static inline const CoefficientWord* decode_single(const CoefficientWord* cursor, __m512i& index, double& value, size_t& single_index)
+{
+    single_index = static_cast<size_t>(_mm_cvtsi128_si64(_mm512_castsi512_si128(index)));
+    cursor = decode_coefficient(cursor, single_index, value);
+    index = _mm512_set1_epi64(static_cast<int64_t>(single_index));
+    return cursor;
+}
+
+TARGET_AVX512 static inline const CoefficientWord* evaluate_single_avx512(const CoefficientWord* cursor, __m512i& index, const array<double, 2>* parameters, __m128d& pair_sum)
+{
+    double value;
+    size_t single_index;
+    cursor = decode_single(cursor, index, value, single_index);
+    pair_sum = _mm_fmadd_pd(_mm_loadu_pd(parameters[single_index].data()), _mm_set1_pd(value), pair_sum);
+    return cursor;
+}
+
+TARGET_AVX512 static inline const CoefficientWord* add_gradient_single_avx512(const CoefficientWord* cursor, __m512i& index, array<double, 2>* gradient, const __m128d scale_pair)
+{
+    double value;
+    size_t single_index;
+    cursor = decode_single(cursor, index, value, single_index);
+    auto* element = gradient[single_index].data();
+    _mm_storeu_pd(element, _mm_fmadd_pd(scale_pair, _mm_set1_pd(value), _mm_loadu_pd(element)));
+    return cursor;
+}
+
+// Lanes of the first and second half of a block holding the first count coefficients
+static inline void get_tail_masks(const size_t count, __mmask8& first_mask, __mmask8& second_mask)
+{
+    first_mask = static_cast<__mmask8>((1u << (2 * min<size_t>(count, 4))) - 1);
+    second_mask = static_cast<__mmask8>((1u << (2 * (count > 4 ? count - 4 : 0))) - 1);
+}
+
+// Eight coefficients per step, the indices are decoded in registers and both phases of four coefficients are gathered at once.
+// The last partial block is copied out so the load stays within the entry, its unused lanes are masked off.
+// Blocks containing an escape are stepped through one coefficient at a time until the escape is passed.
+TARGET_AVX512 static void evaluate_avx512(const CoefficientWord* cursor, const CoefficientWord* const end, const array<double, 2>* parameters, array<double, 2>& sums)
+{
+    const auto* base = parameters->data();
+    auto index = _mm512_setzero_si512();
+    auto first_sum = _mm512_setzero_pd();
+    auto second_sum = _mm512_setzero_pd();
+    auto escaped_sum = _mm_setzero_pd();
+    while (cursor + 8 <= end)
+    {
+        const auto words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cursor));
+        if (has_escaped_words(words, 8)) [[unlikely]]
+        {
+            cursor = evaluate_single_avx512(cursor, index, parameters, escaped_sum);
+            continue;
+        }
+
+        const auto block = decode_block(words, index);
+        first_sum = _mm512_fmadd_pd(_mm512_i64gather_pd(block.first_offsets, base, 8), block.first_values, first_sum);
+        second_sum = _mm512_fmadd_pd(_mm512_i64gather_pd(block.second_offsets, base, 8), block.second_values, second_sum);
+        cursor += 8;
+    }
+
+    if (cursor < end)
+    {
+        const auto count = static_cast<size_t>(end - cursor);
+        CoefficientWord tail[8] = {};
+        memcpy(tail, cursor, count * sizeof(CoefficientWord));
+        const auto tail_words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tail));
+        if (has_escaped_words(tail_words, count))
+        {
+            while (cursor < end)
+            {
+                cursor = evaluate_single_avx512(cursor, index, parameters, escaped_sum);
+            }
+        }
+        else
+        {
+            const auto block = decode_block(tail_words, index);
+            __mmask8 first_mask;
+            __mmask8 second_mask;
+            get_tail_masks(count, first_mask, second_mask);
+            const auto zero = _mm512_setzero_pd();
+            first_sum = _mm512_fmadd_pd(_mm512_mask_i64gather_pd(zero, first_mask, block.first_offsets, base, 8), block.first_values, first_sum);
+            second_sum = _mm512_fmadd_pd(_mm512_mask_i64gather_pd(zero, second_mask, block.second_offsets, base, 8), block.second_values, second_sum);
+        }
+    }
+
+    const auto sum = _mm512_add_pd(first_sum, second_sum);
+    const auto quad_sum = _mm256_add_pd(_mm512_castpd512_pd256(sum), _mm512_extractf64x4_pd(sum, 1));
+    const auto pair_sum = _mm_add_pd(_mm_add_pd(_mm256_castpd256_pd128(quad_sum), _mm256_extractf128_pd(quad_sum, 1)), escaped_sum);
+    _mm_storeu_pd(sums.data(), _mm_add_pd(_mm_loadu_pd(sums.data()), pair_sum));
+}
+
+// The coefficients of an entry have distinct indices, so the lanes of a scatter never write the same element
+TARGET_AVX512 static void add_gradient_avx512(const CoefficientWord* cursor, const CoefficientWord* const end, array<double, 2>* gradient, const array<double, 2>& scale)
+{
+    auto* base = gradient->data();
+    const auto scale_pairs = _mm512_set_pd(scale[1], scale[0], scale[1], scale[0], scale[1], scale[0], scale[1], scale[0]);
+    const auto scale_pair = _mm_loadu_pd(scale.data());
+    auto index = _mm512_setzero_si512();
+    while (cursor + 8 <= end)
+    {
+        const auto words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cursor));
+        if (has_escaped_words(words, 8)) [[unlikely]]
+        {
+            cursor = add_gradient_single_avx512(cursor, index, gradient, scale_pair);
+            continue;
+        }
+
+        const auto block = decode_block(words, index);
+        const auto first = _mm512_i64gather_pd(block.first_offsets, base, 8);
+        _mm512_i64scatter_pd(base, block.first_offsets, _mm512_fmadd_pd(scale_pairs, block.first_values, first), 8);
+        const auto second = _mm512_i64gather_pd(block.second_offsets, base, 8);
+        _mm512_i64scatter_pd(base, block.second_offsets, _mm512_fmadd_pd(scale_pairs, block.second_values, second), 8);
+        cursor += 8;
+    }
+
+    if (cursor < end)
+    {
+        const auto count = static_cast<size_t>(end - cursor);
+        CoefficientWord tail[8] = {};
+        memcpy(tail, cursor, count * sizeof(CoefficientWord));
+        const auto tail_words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tail));
+        if (has_escaped_words(tail_words, count))
+        {
+            while (cursor < end)
+            {
+                cursor = add_gradient_single_avx512(cursor, index, gradient, scale_pair);
+            }
+        }
+        else
+        {
+            const auto block = decode_block(tail_words, index);
+            __mmask8 first_mask;
+            __mmask8 second_mask;
+            get_tail_masks(count, first_mask, second_mask);
+            const auto zero = _mm512_setzero_pd();
+            const auto first = _mm512_mask_i64gather_pd(zero, first_mask, block.first_offsets, base, 8);
+            _mm512_mask_i64scatter_pd(base, first_mask, block.first_offsets, _mm512_fmadd_pd(scale_pairs, block.first_values, first), 8);
+            const auto second = _mm512_mask_i64gather_pd(zero, second_mask, block.second_offsets, base, 8);
+            _mm512_mask_i64scatter_pd(base, second_mask, block.second_offsets, _mm512_fmadd_pd(scale_pairs, block.second_values, second), 8);
+        }
+    }
+}
+
+static constexpr VectorKernels avx2_kernels{KernelIsa::Avx2, evaluate_avx2, add_gradient_avx2};
+static constexpr VectorKernels avx512_kernels{KernelIsa::Avx512, evaluate_avx512, add_gradient_avx512};
+
+#endif
+
+const VectorKernels* get_vector_kernels(const KernelIsa max_isa)
+{
+#if VECTOR_KERNELS_X86
+    static const auto supported_isa = get_supported_isa();
+    const auto isa = min(supported_isa, max_isa);
+    if (isa == KernelIsa::Avx512)
+    {
+        return &avx512_kernels;
+    }
+    if (isa == KernelIsa::Avx2)
+    {
+        return &avx2_kernels;
+    }
+#endif
+    return nullptr;
+}
+
+const char* get_kernel_isa_name(const KernelIsa isa)
+{
+    switch (isa)
+    {
+    case KernelIsa::Avx2:
+        return "AVX2";
+    case KernelIsa::Avx512:
+        return "AVX-512";
+    default:
+        return "scalar";
+    }
+}
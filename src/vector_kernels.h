@@ -0,0 +1,27 @@
+#ifndef VECTOR_KERNELS_H
+#define VECTOR_KERNELS_H 1
+
+#include "config.h"
+#include "entry.h"
+
+#include <array>
+
+// Hand-vectorized sparse parts of the tapered double precision epoch kernels. The midgame and endgame values of
+// a parameter are adjacent in memory and are kept in adjacent lanes, so one load or FMA covers both phases of a
+// coefficient. Escaped coefficients are decoded one at a time in between the vectorized blocks.
+struct VectorKernels
+{
+    KernelIsa isa;
+    // sums[phase] += parameters[index][phase] * value for each coefficient
+    void (*evaluate)(const CoefficientWord* begin, const CoefficientWord* end, const std::array<double, 2>* parameters, std::array<double, 2>& sums);
+    // gradient[index][phase] += scale[phase] * value for each coefficient
+    void (*add_gradient)(const CoefficientWord* begin, const CoefficientWord* end, std::array<double, 2>* gradient, const std::array<double, 2>& scale);
+};
+
+// Kernels for the best instruction set both the processor and max_isa allow, detected once.
+// nullptr when that is KernelIsa::Scalar, the kernels are then left to the compiler.
+const VectorKernels* get_vector_kernels(KernelIsa max_isa);
+
+const char* get_kernel_isa_name(KernelIsa isa);
+
+#endif // !VECTOR_KERNELS_H